@@ -0,0 +1,59 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+/* A backend is whatever gives us something to draw on: a GL context, and
+   (maybe) a window to show it in. view.c does all the drawing, and
+   doesn't care which backend it's drawing for. */
+
+/* Extra heads: more windows, on other screens or displays, all showing
+   the same simulation. Each is turned spin degrees about the vertical
+   axis from the main window's view. */
+#define MAX_HEADS (8)
+
+typedef struct headopts_struct {
+  char *dpystr; /* NULL for the main window's display */
+  GLfloat spin;
+} headopts_t;
+
+/* What init_view() worked out from the command line. The backend fills
+   in width and height with the size it actually got. */
+typedef struct viewopts_struct {
+  char *dpystr;
+  char *geom;
+  int fullscreen;
+  int on_root;
+  int offscreen; /* draw into a framebuffer object, never onto a window */
+  int soft; /* no GL; soft.c draws, and the backend shows its pixels */
+  int width, height;
+  int argc;
+  char **argv;
+  int numheads;
+  headopts_t *heads;
+} viewopts_t;
+
+typedef struct backend_struct {
+  char *name;
+  /* Open up shop, and make a GL context current (unless opts->soft). */
+  int (*init)(viewopts_t *opts);
+  /* The drawing size changed; win_reshape() calls this. */
+  void (*resize)(int width, int height);
+  /* Show the frame just drawn. */
+  void (*present)(void);
+  /* A file descriptor to wait on for events, or -1. */
+  int (*fd)(void);
+  /* Whether anything we draw can be seen. */
+  int (*visible)(void);
+  /* Handle whatever events have arrived. */
+  void (*events)(void);
+  /* Start the extra heads drawing the current elist, and wait for them to
+     be done with it. */
+  void (*heads_begin)(void);
+  void (*heads_end)(void);
+} backend_t;
+
+extern backend_t backend_x11;
+extern backend_t backend_egl;
@@ -0,0 +1,130 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+/* The control socket (--control PATH). This is a Unix-domain datagram
+   socket; each datagram is one command:
+     next        switch to the next look
+     look NAME   switch to the named look
+   For example: echo next | socat - UNIX-SENDTO:/tmp/stonerview
+   (SIGHUP does the same as "next".) */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <GL/gl.h>
+
+#include "general.h"
+#include "osc.h"
+#include "move.h"
+#include "view.h"
+#include "control.h"
+
+char *control_path = NULL;
+
+static int sock = -1;
+
+static void final_control(void);
+
+int init_control()
+{
+  struct sockaddr_un addr;
+  struct stat st;
+
+  if (!control_path)
+    return TRUE;
+
+  if (strlen(control_path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "%s: control socket path is too long\n", progname);
+    return FALSE;
+  }
+
+  sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (sock < 0) {
+    perror("socket");
+    return FALSE;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, control_path);
+  /* A socket left over from a run that didn't clean up would be in the
+     way. Anything else there is somebody's file, and a mistyped path
+     shouldn't cost them it. */
+  if (lstat(control_path, &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      fprintf(stderr, "%s: %s exists and isn't a socket\n", progname,
+	control_path);
+      close(sock);
+      sock = -1;
+      return FALSE;
+    }
+    unlink(control_path);
+  }
+  else if (errno != ENOENT) {
+    perror(control_path);
+    close(sock);
+    sock = -1;
+    return FALSE;
+  }
+  if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    perror(control_path);
+    close(sock);
+    sock = -1;
+    return FALSE;
+  }
+
+  atexit(final_control);
+  return TRUE;
+}
+
+static void final_control()
+{
+  if (sock >= 0) {
+    close(sock);
+    unlink(control_path);
+  }
+}
+
+/* The file descriptor for the main loop to wait on, or -1. */
+int control_fd()
+{
+  return sock;
+}
+
+/* Handle whatever commands have come in. */
+void control_read()
+{
+  char buf[256];
+  ssize_t len;
+
+  while ((len = recv(sock, buf, sizeof(buf)-1, 0)) > 0) {
+    char *cx;
+    buf[len] = '\0';
+    cx = strchr(buf, '\n');
+    if (cx)
+      *cx = '\0';
+
+    if (!strcmp(buf, "next")) {
+      move_swap(-1);
+    }
+    else if (!strncmp(buf, "look ", 5)) {
+      int look = move_find_look(buf+5);
+      if (look < 0)
+	fprintf(stderr, "%s: no such look: %s\n", progname, buf+5);
+      else
+	move_swap(look);
+    }
+    else {
+      fprintf(stderr, "%s: unknown control command: %s\n", progname, buf);
+    }
+  }
+}
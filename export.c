@@ -0,0 +1,363 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+/* Exporting frames to a video stream, instead of showing them in a window.
+
+   We draw each frame into an offscreen framebuffer and read it back. The
+   naive way to read it back (glReadPixels into memory) waits for the
+   frame to finish drawing, which leaves the GL idle while we wait and us
+   idle while it draws. So instead we read into a ring of pixel buffer
+   objects, and only look at each one a couple of frames later, by which
+   time it's long since done.
+
+   The pixels then go into a queue for a writer thread, which converts
+   them to the output format and writes them out. If the file is called
+   something.ppm, we write a stream of raw PPM images; otherwise it's a
+   YUV4MPEG2 (Y4M) stream, which ffmpeg and friends read happily. A
+   filename of "-" means stdout. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+
+#include "general.h"
+#include "view.h"
+#include "export.h"
+
+/* Set by the --export, --frames, and --size options. export_frames of
+   zero means keep going until killed. */
+char *export_file = NULL;
+int export_frames = 0;
+int export_width = 640, export_height = 480;
+
+#define PBO_RING (3) /* frames in flight between drawing and reading */
+#define QUEUE_LEN (8) /* frames waiting for the writer thread */
+
+#define FORMAT_Y4M (1)
+#define FORMAT_PPM (2)
+
+static FILE *outfile = NULL;
+static int format = FORMAT_Y4M;
+static size_t framesize; /* bytes in one BGRA frame */
+
+static int use_pbo = FALSE;
+static GLuint pbos[PBO_RING];
+static long issued = 0; /* frames sent to glReadPixels */
+
+/* The queue to the writer thread. Frames go in and out in order, so the
+   queue is just a ring of buffers and two counters. */
+static unsigned char *queue[QUEUE_LEN];
+static long produced = 0, consumed = 0;
+static int finished = FALSE;
+static pthread_t writer;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_notfull = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queue_notempty = PTHREAD_COND_INITIALIZER;
+
+static void *writer_thread(void *rock);
+static void write_y4m(unsigned char *bgra, unsigned char *out);
+static void write_ppm(unsigned char *bgra, unsigned char *out);
+static unsigned char *claim_buffer(void);
+static void submit_buffer(void);
+static void collect(int slot);
+
+/* Open the output and get the writer thread going. This must be called
+   after the GL context exists. */
+int init_export()
+{
+  int ix;
+  int len = strlen(export_file);
+  const char *version;
+
+  if (len > 4 && !strcmp(export_file+len-4, ".ppm"))
+    format = FORMAT_PPM;
+  else
+    format = FORMAT_Y4M;
+
+  if (!strcmp(export_file, "-")) {
+    outfile = stdout;
+  }
+  else {
+    outfile = fopen(export_file, "wb");
+    if (!outfile) {
+      fprintf(stderr, "%s: ", progname);
+      perror(export_file);
+      return FALSE;
+    }
+  }
+
+  framesize = (size_t)export_width * export_height * 4;
+  for (ix=0; ix<QUEUE_LEN; ix++) {
+    queue[ix] = (unsigned char *)malloc(framesize);
+    if (!queue[ix]) {
+      fprintf(stderr, "%s: out of memory\n", progname);
+      return FALSE;
+    }
+  }
+
+  /* Pixel buffer objects are core in GL 2.1. Without them we fall back to
+     plain glReadPixels, which works, just not as fast. (With the software
+     renderer there's no GL context at all, and version is NULL.) */
+  version = (const char *)glGetString(GL_VERSION);
+  use_pbo = (version && (version[0] > '2'
+    || (version[0] == '2' && version[2] >= '1')));
+  if (use_pbo) {
+    glGenBuffers(PBO_RING, pbos);
+    for (ix=0; ix<PBO_RING; ix++) {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[ix]);
+      glBufferData(GL_PIXEL_PACK_BUFFER, framesize, NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+  if (version)
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+  if (format == FORMAT_Y4M) {
+    /* Each frame is one simulation step, so that's our frame rate.
+       write_y4m() uses the whole 0-255 range, as JPEG does; C420jpeg
+       only says where the chroma samples sit, and a reader that isn't
+       told otherwise assumes 16-235, hence XCOLORRANGE. */
+    fprintf(outfile,
+      "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n",
+      export_width, export_height, 1000 / TICKRATE);
+  }
+
+  if (pthread_create(&writer, NULL, writer_thread, NULL)) {
+    fprintf(stderr, "%s: couldn't start the writer thread\n", progname);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Flush out the frames still in flight, wait for the writer to catch up,
+   and close the output. */
+void final_export()
+{
+  long frame;
+  long first = issued - PBO_RING;
+
+  if (!outfile)
+    return;
+
+  if (use_pbo) {
+    if (first < 0)
+      first = 0;
+    for (frame = first; frame < issued; frame++)
+      collect(frame % PBO_RING);
+  }
+
+  pthread_mutex_lock(&queue_lock);
+  finished = TRUE;
+  pthread_cond_signal(&queue_notempty);
+  pthread_mutex_unlock(&queue_lock);
+  pthread_join(writer, NULL);
+
+  if (outfile != stdout)
+    fclose(outfile);
+  else
+    fflush(outfile);
+  outfile = NULL;
+}
+
+/* Start reading back the frame that was just drawn into the current
+   read framebuffer. With PBOs, this doesn't wait for anything; the
+   pixels are picked up PBO_RING-1 frames later. */
+void export_readback()
+{
+  int slot;
+
+  if (!use_pbo) {
+    glReadPixels(0, 0, export_width, export_height,
+      GL_BGRA, GL_UNSIGNED_BYTE, claim_buffer());
+    submit_buffer();
+    return;
+  }
+
+  slot = issued % PBO_RING;
+  if (issued >= PBO_RING)
+    collect(slot);
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+  glReadPixels(0, 0, export_width, export_height,
+    GL_BGRA, GL_UNSIGNED_BYTE, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  issued++;
+}
+
+/* Hand the writer a frame that's already in memory (from the software
+   renderer, say). Rows are stride bytes apart, and run top to bottom if
+   topdown is set, bottom to top (the GL way) if not. */
+void export_pixels(unsigned char *bgra, int stride, int topdown)
+{
+  unsigned char *buf = claim_buffer();
+  int y;
+
+  for (y=0; y<export_height; y++) {
+    int srcrow = topdown ? (export_height-1-y) : y;
+    memcpy(buf + (size_t)y * export_width * 4,
+      bgra + (size_t)srcrow * stride, export_width * 4);
+  }
+  submit_buffer();
+}
+
+/* Copy the pixels out of one PBO and hand them to the writer. */
+static void collect(int slot)
+{
+  void *ptr;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+  ptr = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+  if (ptr) {
+    memcpy(claim_buffer(), ptr, framesize);
+    submit_buffer();
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+/* Get the next empty queue buffer, waiting for the writer if the queue is
+   full. */
+static unsigned char *claim_buffer()
+{
+  unsigned char *buf;
+
+  pthread_mutex_lock(&queue_lock);
+  while (produced - consumed >= QUEUE_LEN)
+    pthread_cond_wait(&queue_notfull, &queue_lock);
+  buf = queue[produced % QUEUE_LEN];
+  pthread_mutex_unlock(&queue_lock);
+
+  return buf;
+}
+
+/* Pass the buffer we got from claim_buffer() to the writer. */
+static void submit_buffer()
+{
+  pthread_mutex_lock(&queue_lock);
+  produced++;
+  pthread_cond_signal(&queue_notempty);
+  pthread_mutex_unlock(&queue_lock);
+}
+
+static void *writer_thread(void *rock)
+{
+  unsigned char *out;
+  size_t outsize;
+
+  if (format == FORMAT_Y4M)
+    outsize = (size_t)export_width * export_height
+      + 2 * (size_t)((export_width+1)/2) * ((export_height+1)/2);
+  else
+    outsize = (size_t)export_width * export_height * 3;
+  out = (unsigned char *)malloc(outsize);
+  if (!out) {
+    fprintf(stderr, "%s: out of memory\n", progname);
+    exit(1);
+  }
+
+  while (1) {
+    unsigned char *buf;
+
+    pthread_mutex_lock(&queue_lock);
+    while (produced == consumed && !finished)
+      pthread_cond_wait(&queue_notempty, &queue_lock);
+    if (produced == consumed) {
+      pthread_mutex_unlock(&queue_lock);
+      break;
+    }
+    buf = queue[consumed % QUEUE_LEN];
+    pthread_mutex_unlock(&queue_lock);
+
+    if (format == FORMAT_Y4M) {
+      fputs("FRAME\n", outfile);
+      write_y4m(buf, out);
+    }
+    else {
+      fprintf(outfile, "P6\n%d %d\n255\n", export_width, export_height);
+      write_ppm(buf, out);
+    }
+    if (fwrite(out, 1, outsize, outfile) != outsize) {
+      fprintf(stderr, "%s: error writing %s\n", progname, export_file);
+      exit(1);
+    }
+
+    pthread_mutex_lock(&queue_lock);
+    consumed++;
+    pthread_cond_signal(&queue_notfull);
+    pthread_mutex_unlock(&queue_lock);
+  }
+
+  free(out);
+  return NULL;
+}
+
+/* GL hands us rows bottom to top; both output formats want them top to
+   bottom. This finds the pixel at (x,y), counting from the top. */
+#define PIXEL(bgra, x, y) \
+  ((bgra) + ((size_t)(export_height-1-(y)) * export_width + (x)) * 4)
+
+static void write_ppm(unsigned char *bgra, unsigned char *out)
+{
+  int x, y;
+
+  for (y=0; y<export_height; y++) {
+    for (x=0; x<export_width; x++) {
+      unsigned char *px = PIXEL(bgra, x, y);
+      *out++ = px[2];
+      *out++ = px[1];
+      *out++ = px[0];
+    }
+  }
+}
+
+/* Convert to full-range BT.601 Y'CbCr, with the chroma averaged over
+   2x2 blocks (that's what C420jpeg means). The coefficients are scaled
+   up by 65536. */
+static void write_y4m(unsigned char *bgra, unsigned char *out)
+{
+  int x, y;
+  int cw = (export_width+1) / 2;
+  int ch = (export_height+1) / 2;
+  unsigned char *yplane = out;
+  unsigned char *uplane = yplane + (size_t)export_width * export_height;
+  unsigned char *vplane = uplane + (size_t)cw * ch;
+
+  for (y=0; y<export_height; y++) {
+    for (x=0; x<export_width; x++) {
+      unsigned char *px = PIXEL(bgra, x, y);
+      *yplane++ = (19595 * px[2] + 38470 * px[1] + 7471 * px[0]
+	+ 32768) >> 16;
+    }
+  }
+
+  for (y=0; y<ch; y++) {
+    for (x=0; x<cw; x++) {
+      int x1 = (2*x+1 < export_width) ? 2*x+1 : 2*x;
+      int y1 = (2*y+1 < export_height) ? 2*y+1 : 2*y;
+      unsigned char *p00 = PIXEL(bgra, 2*x, 2*y);
+      unsigned char *p01 = PIXEL(bgra, x1, 2*y);
+      unsigned char *p10 = PIXEL(bgra, 2*x, y1);
+      unsigned char *p11 = PIXEL(bgra, x1, y1);
+      int r = p00[2] + p01[2] + p10[2] + p11[2];
+      int g = p00[1] + p01[1] + p10[1] + p11[1];
+      int b = p00[0] + p01[0] + p10[0] + p11[0];
+      int u, v;
+      /* r, g, b are four times the average, hence the extra >> 2. */
+      u = (128 * 4 * 65536 - 11059 * r - 21709 * g + 32768 * b
+	+ 4 * 32768) >> 18;
+      v = (128 * 4 * 65536 + 32768 * r - 27439 * g - 5329 * b
+	+ 4 * 32768) >> 18;
+      *uplane++ = (u > 255) ? 255 : u;
+      *vplane++ = (v > 255) ? 255 : v;
+    }
+  }
+}
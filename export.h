@@ -0,0 +1,15 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+extern char *export_file;
+extern int export_frames;
+extern int export_width, export_height;
+
+extern int init_export(void);
+extern void export_readback(void);
+extern void export_pixels(unsigned char *bgra, int stride, int topdown);
+extern void final_export(void);
@@ -9,6 +9,10 @@
 #define M_PI 3.14159265
 #endif
 
+#define FRAMERATE (20) /* milliseconds per drawn frame, by default */
+#define TICKRATE (20) /* milliseconds per simulation step */
+#define MAX_CATCHUP (5) /* most simulation steps to run between frames */
+
 #ifndef FALSE
 #define FALSE 0
 #endif
@@ -0,0 +1,135 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+/* The quality governor. If the user gives a frame-time budget (--budget),
+   we watch how long each frame takes, and when we're consistently over
+   budget we turn the quality down a notch. When we're consistently well
+   under budget, we turn it back up. The gap between the two thresholds,
+   and the waiting period after every change, keep us from flapping back
+   and forth between two levels. */
+
+#include <stdio.h>
+#include <GL/gl.h>
+
+#include "general.h"
+#include "view.h"
+#include "governor.h"
+
+/* The frame-time budget, in milliseconds. Zero means the governor is
+   turned off. */
+double gov_budget = 0.0;
+
+/* Simulation steps are stretched to gov_tickdiv times TICKRATE. */
+int gov_tickdiv = 1;
+
+/* The quality levels, best first. Each one is at least as cheap as the one
+   before. Knobs that don't apply (edges when --edges wasn't given, scale
+   when there are no framebuffer objects) just have no effect. */
+static struct govlevel_struct {
+  int edges; /* draw edges, if the user asked for them */
+  double scale; /* cap on the render scale */
+  int stride; /* draw every stride'th element */
+  int tickdiv; /* divide the simulation tick rate by this */
+} levels[] = {
+  { TRUE,  1.0,  1, 1 },
+  { FALSE, 1.0,  1, 1 },
+  { FALSE, 0.75, 1, 1 },
+  { FALSE, 0.5,  1, 1 },
+  { FALSE, 0.5,  2, 1 },
+  { FALSE, 0.35, 2, 1 },
+  { FALSE, 0.35, 2, 2 },
+  { FALSE, 0.25, 4, 2 },
+};
+
+#define NUM_LEVELS (sizeof(levels) / sizeof(*levels))
+
+/* Frames of consistent overrun before we drop a level. */
+#define DEGRADE_FRAMES (10)
+/* Frames of consistent slack before we climb a level. This is much longer,
+   because a wrong guess upward costs a visible stutter. */
+#define UPGRADE_FRAMES (150)
+/* We climb only when the average is below this fraction of the budget. */
+#define UPGRADE_SLACK (0.6)
+/* Frames to ignore after a change, while the new level settles. */
+#define SETTLE_FRAMES (25)
+
+static int curlevel = 0;
+static double avg = 0.0;
+static int overcount = 0, undercount = 0;
+static int settle = 0;
+
+static void set_level(int level);
+
+void init_governor()
+{
+  if (gov_budget <= 0.0)
+    return;
+  set_level(0);
+  settle = SETTLE_FRAMES;
+}
+
+/* Called once per frame with the time the frame took (drawing and
+   simulation, not sleeping). */
+void governor_frame(double ms)
+{
+  if (gov_budget <= 0.0)
+    return;
+
+  if (settle > 0) {
+    settle--;
+    avg = ms;
+    return;
+  }
+
+  avg = avg * 0.8 + ms * 0.2;
+
+  if (avg > gov_budget) {
+    overcount++;
+    undercount = 0;
+  }
+  else if (avg < gov_budget * UPGRADE_SLACK) {
+    undercount++;
+    overcount = 0;
+  }
+  else {
+    overcount = 0;
+    undercount = 0;
+  }
+
+  if (overcount >= DEGRADE_FRAMES && curlevel+1 < NUM_LEVELS) {
+    fprintf(stderr, "%s: governor: %.1f ms/frame over %.1f ms budget\n",
+      progname, avg, gov_budget);
+    set_level(curlevel+1);
+  }
+  else if (undercount >= UPGRADE_FRAMES && curlevel > 0) {
+    fprintf(stderr, "%s: governor: %.1f ms/frame well under %.1f ms budget\n",
+      progname, avg, gov_budget);
+    set_level(curlevel-1);
+  }
+}
+
+static void set_level(int level)
+{
+  struct govlevel_struct *lev = &levels[level];
+
+  if (level != curlevel) {
+    fprintf(stderr,
+      "%s: governor: level %d: edges %s, scale %.2f, stride %d, tick 1/%d\n",
+      progname, level, (lev->edges ? "on" : "off"), lev->scale,
+      lev->stride, lev->tickdiv);
+  }
+
+  curlevel = level;
+  view_set_edges(lev->edges);
+  view_set_scale_limit(lev->scale);
+  view_set_stride(lev->stride);
+  gov_tickdiv = lev->tickdiv;
+
+  overcount = 0;
+  undercount = 0;
+  settle = SETTLE_FRAMES;
+}
@@ -0,0 +1,12 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+extern double gov_budget;
+extern int gov_tickdiv;
+
+extern void init_governor(void);
+extern void governor_frame(double ms);
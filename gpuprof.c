@@ -0,0 +1,154 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+/* --gpu-profile: how long the card spends on each drawing pass, next to
+   how long the CPU spends handing it over. Timing win_draw() on the CPU
+   doesn't say much, since the work really happens inside glFinish() or
+   the swap. So each pass is wrapped in a GL_TIME_ELAPSED query. Asking
+   for a result right away would stall until the card caught up, so the
+   queries go in a ring a few frames deep, and each result is read just
+   before its query is reused. A result that still isn't ready by then is
+   dropped, not waited for.
+
+   Every REPORT_FRAMES frames we print the averages. If the GPU time is
+   most of the frame, we're fill-bound; if the submit time is, we're
+   CPU-bound. */
+
+#include <stdio.h>
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "general.h"
+#include "view.h"
+#include "gpuprof.h"
+
+/* How many frames a query has to finish in. */
+#define RING_FRAMES (4)
+
+#define REPORT_FRAMES (120)
+
+int gpu_profile = FALSE;
+
+/* Only the main view's context is timed; the other heads draw on their
+   own threads, with their own contexts. */
+static __thread int profiling = FALSE;
+
+static GLuint queries[RING_FRAMES][GPU_PASSES];
+static int issued[RING_FRAMES][GPU_PASSES];
+static int curslot = 0;
+
+static double gpu_sum[GPU_PASSES];
+static int gpu_count[GPU_PASSES];
+static double submit_sum = 0.0, frame_sum = 0.0;
+static int frames = 0, dropped = 0;
+
+static void report(void);
+
+/* Set up the queries in the current context, if it can do them. */
+void gpuprof_init()
+{
+  const char *version = (const char *)glGetString(GL_VERSION);
+  int major = 0, minor = 0;
+
+  if (!gpu_profile)
+    return;
+
+  if (version)
+    sscanf(version, "%d.%d", &major, &minor);
+  if (major*10 + minor < 33 && !gl_has_extension("GL_ARB_timer_query")) {
+    fprintf(stderr, "%s: no GL timer queries; ignoring --gpu-profile\n",
+      progname);
+    gpu_profile = FALSE;
+    return;
+  }
+
+  glGenQueries(RING_FRAMES * GPU_PASSES, &queries[0][0]);
+  profiling = TRUE;
+}
+
+/* Start and stop timing one pass of the current frame. */
+
+void gpuprof_begin(int pass)
+{
+  if (!profiling)
+    return;
+  glBeginQuery(GL_TIME_ELAPSED, queries[curslot][pass]);
+  issued[curslot][pass] = TRUE;
+}
+
+void gpuprof_end(int pass)
+{
+  if (!profiling)
+    return;
+  glEndQuery(GL_TIME_ELAPSED);
+}
+
+/* Called at the end of each frame, with how long the CPU took to issue
+   the drawing and how long the whole frame took. Moves on to the next
+   slot of the ring, collecting whatever was timed there last time
+   around. */
+void gpuprof_frame(double submit_ms, double frame_ms)
+{
+  int pass;
+
+  if (!profiling)
+    return;
+
+  submit_sum += submit_ms;
+  frame_sum += frame_ms;
+  frames++;
+
+  curslot = (curslot + 1) % RING_FRAMES;
+  for (pass=0; pass<GPU_PASSES; pass++) {
+    GLint avail = 0;
+    GLuint64 nsec = 0;
+    if (!issued[curslot][pass])
+      continue;
+    issued[curslot][pass] = FALSE;
+    glGetQueryObjectiv(queries[curslot][pass], GL_QUERY_RESULT_AVAILABLE,
+      &avail);
+    if (!avail) {
+      dropped++;
+      continue;
+    }
+    glGetQueryObjectui64v(queries[curslot][pass], GL_QUERY_RESULT, &nsec);
+    gpu_sum[pass] += nsec / 1000000.0;
+    gpu_count[pass]++;
+  }
+
+  if (frames >= REPORT_FRAMES)
+    report();
+}
+
+static void report()
+{
+  static char *names[GPU_PASSES] = { "faces", "edges", "faces+edges" };
+  int pass, any = FALSE;
+
+  fprintf(stderr, "%s: gpu:", progname);
+  for (pass=0; pass<GPU_PASSES; pass++) {
+    if (gpu_count[pass]) {
+      fprintf(stderr, "%s %s %.3f ms", (any ? "," : ""), names[pass],
+	gpu_sum[pass] / gpu_count[pass]);
+      any = TRUE;
+    }
+    gpu_sum[pass] = 0.0;
+    gpu_count[pass] = 0;
+  }
+  if (!any)
+    fprintf(stderr, " no results");
+  fprintf(stderr, "; cpu: submit %.2f ms, frame %.2f ms",
+    submit_sum / frames, frame_sum / frames);
+  if (dropped)
+    fprintf(stderr, " (%d results too late)", dropped);
+  fprintf(stderr, "\n");
+
+  submit_sum = frame_sum = 0.0;
+  frames = dropped = 0;
+}
@@ -0,0 +1,19 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+/* The drawing passes that --gpu-profile times. */
+#define GPU_FACES (0)
+#define GPU_EDGES (1)
+#define GPU_BOTH (2) /* faces and edges together, square by square */
+#define GPU_PASSES (3)
+
+extern int gpu_profile;
+
+extern void gpuprof_init(void);
+extern void gpuprof_begin(int pass);
+extern void gpuprof_end(int pass);
+extern void gpuprof_frame(double submit_ms, double frame_ms);
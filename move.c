@@ -6,99 +6,451 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <pthread.h>
 #include <GL/gl.h>
 
 #include "general.h"
 #include "osc.h"
 #include "move.h"
+#include "view.h"
+#include "pool.h"
+#include "state.h"
 
-/* The list of polygons. This is filled in by move_increment(), and rendered
-   by perform_render(). */
+/* The list of polygons. This is filled in by move_interpolate(), and
+   rendered by win_draw(). */
 elem_t elist[NUM_ELS];
 
+/* The simulation runs at a fixed rate, which need not match the frame rate.
+   The chain keeps the polygons from the last two simulation steps, and
+   elist is blended from them. */
+static chain_t *mainchain = NULL;
+
+/* A look is a choice, for each of the four parameters, of which graph
+   init_chain() builds for it. 0 is always the original. */
+typedef struct look_struct {
+  char *name;
+  int theta, rad, alti, color;
+} look_t;
+
+static look_t looks[] = {
+  { "classic",  0, 0, 0, 0 },
+  { "spiral",   1, 0, 0, 0 },
+  { "ring",     0, 1, 0, 0 },
+  { "tumble",   0, 0, 1, 0 },
+  { "confetti", 0, 0, 0, 1 },
+  { "storm",    1, 0, 1, 1 },
+  { "clockwork", 1, 2, 0, 2 },
+};
+#define NUM_LOOKS ((int)(sizeof(looks) / sizeof(*looks)))
+
+/* Whether compute_elist() reads each parameter a block at a time with
+   osc_get_block(), or walks the graph once per element with osc_get().
+   The answers are the same; the walk is slower, and is kept as the
+   reference that "make check-perf" compares the blocks against. */
+int elist_blocks = TRUE;
+
+int move_look = 0; /* what every chain starts with */
+int crossfade_ticks = 0; /* how long a swap takes to blend in */
+
+/* How many megabytes a chain may use to replay its cycle, if its graph
+   has one; 0 means never. */
+int loop_cache_mb = 0;
+
+/* Swapping looks at runtime. A new chain is built, and run until its
+   Buffers are full, on a thread of its own; the main thread only picks
+   it up, at the start of a simulation step, once it's ready. The old
+   chain may carry on for a while, to fade out. Only one chain is built
+   at a time. */
+static pthread_mutex_t swap_lock = PTHREAD_MUTEX_INITIALIZER;
+static int swap_building = FALSE; /* main thread only */
+static int swap_done = FALSE; /* protected by swap_lock */
+static chain_t *swap_ready = NULL; /* ditto */
+static unsigned int swap_seed;
+static int swap_look;
+static chain_t *fading = NULL;
+static int fade_tick = 0;
+static elem_t fade_list[NUM_ELS];
+
+static void *swap_thread(void *rock);
+static void swap_check(void);
+static void free_chain(chain_t *chain);
+static int reshape_chain(chain_t *chain, int look);
+static void chain_loop(chain_t *chain, int leadin);
+static void chain_sync(chain_t *chain);
+static void put_floats(FILE *fl, GLfloat *vals, int count);
+static int get_floats(FILE *fl, GLfloat *vals, int count);
+
+/* An elem_t is nothing but GLfloats, which is how chain_save() writes
+   one out. */
+#define ELEM_FLOATS ((int)(sizeof(elem_t) / sizeof(GLfloat)))
+
+/* Grid mode: a wall of independent universes. These are stepped and
+   blended on the thread pool, since there may be hundreds of them. */
+int grid_cols = 0, grid_rows = 0;
+elem_t *grid_elist = NULL;
+static chain_t *grid = NULL;
+static int grid_count = 0;
+static GLfloat grid_frac = 0.0;
+
+static void compute_elist(chain_t *chain, elem_t *list);
+static void grid_increment_one(int ix, void *rock);
+static void grid_interpolate_one(int ix, void *rock);
+
+int init_move()
+{
+  int ix;
+
+  mainchain = (chain_t *)malloc(sizeof(chain_t));
+  if (!mainchain || !init_chain(mainchain, rand(), move_look))
+    return FALSE;
+  chain_loop(mainchain, NUM_ELS);
+  memcpy(elist, mainchain->cur, sizeof(elist));
+
+  grid_count = grid_cols * grid_rows;
+  if (grid_count) {
+    if (!init_pool())
+      return FALSE;
+    grid = (chain_t *)malloc(grid_count * sizeof(chain_t));
+    grid_elist = (elem_t *)malloc(grid_count * NUM_ELS * sizeof(elem_t));
+    if (!grid || !grid_elist)
+      return FALSE;
+    for (ix=0; ix<grid_count; ix++) {
+      if (!init_chain(&grid[ix], rand(), move_look))
+	return FALSE;
+      memcpy(&grid_elist[ix*NUM_ELS], grid[ix].cur, sizeof(grid[ix].cur));
+    }
+  }
+
+  return TRUE;
+}
+
+/* Find a look by name, or return -1. */
+int move_find_look(char *name)
+{
+  int ix;
+
+  for (ix=0; ix<NUM_LOOKS; ix++) {
+    if (!strcmp(looks[ix].name, name))
+      return ix;
+  }
+  return -1;
+}
+
+/* The name of a look, or NULL if there's no such look. */
+char *move_look_name(int look)
+{
+  if (look < 0 || look >= NUM_LOOKS)
+    return NULL;
+  return looks[look].name;
+}
+
+/* Start building the main chain over again with a new look (or, if look
+   is -1, the next look after the current one). This returns right away;
+   the new chain takes over when it's ready. */
+void move_swap(int look)
+{
+  pthread_t thread;
+  chain_t *chain;
+
+  if (swap_building) {
+    fprintf(stderr, "%s: still building the last look\n", progname);
+    return;
+  }
+  if (look < 0 || look >= NUM_LOOKS)
+    look = (mainchain->look + 1) % NUM_LOOKS;
+
+  chain = (chain_t *)malloc(sizeof(chain_t));
+  if (!chain)
+    return;
+  swap_seed = rand();
+  swap_look = look;
+  if (pthread_create(&thread, NULL, swap_thread, chain)) {
+    free(chain);
+    return;
+  }
+  pthread_detach(thread);
+  swap_building = TRUE;
+}
+
+static void *swap_thread(void *rock)
+{
+  chain_t *chain = rock;
+  int ix;
+
+  if (!init_chain(chain, swap_seed, swap_look)) {
+    free(chain);
+    chain = NULL;
+  }
+  else {
+    /* Run it until every Buffer has a full history. */
+    for (ix=0; ix<NUM_ELS; ix++)
+      chain_increment(chain);
+    chain_loop(chain, 0);
+  }
+
+  pthread_mutex_lock(&swap_lock);
+  swap_ready = chain;
+  swap_done = TRUE;
+  pthread_mutex_unlock(&swap_lock);
+  return NULL;
+}
+
+/* If a new chain is ready, put it in charge. */
+static void swap_check()
+{
+  chain_t *chain = NULL;
+  int done;
+
+  pthread_mutex_lock(&swap_lock);
+  done = swap_done;
+  if (done) {
+    chain = swap_ready;
+    swap_ready = NULL;
+    swap_done = FALSE;
+  }
+  pthread_mutex_unlock(&swap_lock);
+  if (!done)
+    return;
+
+  swap_building = FALSE;
+  if (!chain)
+    return;
+
+  if (fading) {
+    free_chain(fading);
+    fading = NULL;
+  }
+  if (crossfade_ticks > 0) {
+    fading = mainchain;
+    fade_tick = 0;
+  }
+  else {
+    free_chain(mainchain);
+  }
+  mainchain = chain;
+  fprintf(stderr, "%s: now showing %s\n", progname, looks[chain->look].name);
+}
+
+static void free_chain(chain_t *chain)
+{
+  osc_free_graph(&chain->graph);
+  free(chain->loop);
+  free(chain);
+}
+
+/* If the chain's graph is periodic, and one cycle of steps fits in
+   loop_cache_mb, compute them all now, so that chain_increment() can
+   just replay them. First take leadin ordinary steps, which should be
+   enough to fill every Buffer from a fresh start (NUM_ELS), or none if
+   that's already done.
+
+   We trust osc_graph_period() only as far as we can check it: the
+   graph's state after one cycle has to match the state before, or the
+   cache is thrown away. */
+static void chain_loop(chain_t *chain, int leadin)
+{
+  unsigned long limit, period, ix;
+  elem_t *frames;
+  char *before = NULL, *after = NULL;
+  size_t beforelen = 0, afterlen = 0;
+  FILE *fl;
+  int ok;
+
+  if (loop_cache_mb <= 0 || chain->loop)
+    return;
+  limit = ((unsigned long)loop_cache_mb << 20) / sizeof(chain->cur);
+  period = osc_graph_period(&chain->graph, limit);
+  if (!period)
+    return;
+
+  frames = (elem_t *)malloc(period * sizeof(chain->cur));
+  if (!frames)
+    return;
+
+  for (ix=0; ix<leadin; ix++)
+    chain_increment(chain);
+
+  fl = open_memstream(&before, &beforelen);
+  if (fl) {
+    osc_save(&chain->graph, fl);
+    fclose(fl);
+  }
+  for (ix=0; ix<period; ix++) {
+    chain_increment(chain);
+    memcpy(&frames[ix * NUM_ELS], chain->cur, sizeof(chain->cur));
+  }
+  fl = open_memstream(&after, &afterlen);
+  if (fl) {
+    osc_save(&chain->graph, fl);
+    fclose(fl);
+  }
+
+  ok = (before && after && beforelen == afterlen
+    && !memcmp(before, after, beforelen));
+  free(before);
+  free(after);
+  if (!ok) {
+    fprintf(stderr, "%s: %s doesn't repeat after %lu steps; not caching "
+      "it\n", progname, looks[chain->look].name, period);
+    free(frames);
+    return;
+  }
+
+  chain->loop = frames;
+  chain->loop_len = period;
+  chain->loop_pos = 0;
+  chain->loop_lag = 0;
+}
+
+/* Bring a replaying chain's graph up to the step it's showing, so that
+   its state can be saved. Stepping the graph alone is cheap; it's the
+   polygons that cost. */
+static void chain_sync(chain_t *chain)
+{
+  if (!chain->loop)
+    return;
+  for (; chain->loop_lag; chain->loop_lag--)
+    osc_increment(&chain->graph);
+}
+
 /* The polygons are controlled by four parameters. Each is represented by
    an osc_t object, which is just something that returns a stream of numbers.
    (Originally the name stood for "oscillator", but it does ever so much more
    now... see osc.c.)
    Imagine a cylinder with a vertical axis (along the Z axis), stretching from
    Z=1 to Z=-1, and a radius of 1.
+     theta: Angle around the axis. This is expressed in hundredths of a
+   degree, so it's actually 0 to 36000.
+     rad: Distance from the axis. This goes up to 1000, but we actually allow
+   negative distances -- that just goes to the opposite side of the circle --
+   so the range is really -1000 to 1000.
+     alti: Height (Z position). This goes from -1000 to 1000.
+     color: Consider this to be an angle of a circle going around the color
+   wheel. It's in tenths of a degree (consistency is all I ask) so it ranges
+   from 0 to 3600.
+   Each chain builds its own, in its own graph, with its own random seed.
 */
-static osc_t *theta = NULL; /* Angle around the axis. This is expressed in
-   hundredths of a degree, so it's actually 0 to 36000. */
-static osc_t *rad = NULL; /* Distance from the axis. This goes up to 1000,
-   but we actually allow negative distances -- that just goes to the opposite
-   side of the circle -- so the range is really -1000 to 1000. */
-static osc_t *alti = NULL; /* Height (Z position). This goes from -1000 to
-   1000. */
-static osc_t *color = NULL; /* Consider this to be an angle of a circle going
-   around the color wheel. It's in tenths of a degree (consistency is all I
-   ask) so it ranges from 0 to 3600. */
-
-int init_move()
+int init_chain(chain_t *chain, unsigned int seed, int look)
 {
-  /*theta = new_osc_linear(
-    new_osc_wrap(0, 36000, 25),
-    new_osc_constant(2000));*/
-
-  theta = new_osc_linear(
-    new_osc_velowrap(0, 36000, new_osc_multiplex(
-      new_osc_randphaser(300, 600),
-      new_osc_constant(25),
-      new_osc_constant(75),
-      new_osc_constant(50),
-      new_osc_constant(100))
-    ),
-
-    new_osc_multiplex(
-      new_osc_buffer(new_osc_randphaser(300, 600)),
-      new_osc_buffer(new_osc_wrap(0, 36000, 10)),
-      new_osc_buffer(new_osc_wrap(0, 36000, -8)),
-      new_osc_wrap(0, 36000, 4),
-      new_osc_buffer(new_osc_bounce(-2000, 2000, 20))
-      )
-    );
-
-  rad = new_osc_buffer(new_osc_multiplex(
-    new_osc_randphaser(250, 500),
-    new_osc_bounce(-1000, 1000, 10),
-    new_osc_bounce(  200, 1000, -15),
-    new_osc_bounce(  400, 1000, 10),
-    new_osc_bounce(-1000, 1000, -20)));
-  /*rad = new_osc_constant(1000);*/
-
-  alti = new_osc_linear(
-    new_osc_constant(-1000),
-    new_osc_constant(2000 / NUM_ELS));
-
-  /*alti = new_osc_multiplex(
-    new_osc_buffer(new_osc_randphaser(60, 270)),
-    new_osc_buffer(new_osc_bounce(-1000, 1000, 48)),
-    new_osc_linear(
-      new_osc_constant(-1000),
-      new_osc_constant(2000 / NUM_ELS)),
-    new_osc_buffer(new_osc_bounce(-1000, 1000, 27)),
+  osc_t *theta, *rad, *alti, *color;
+
+  chain->look = look;
+  chain->loop = NULL;
+  osc_init_graph(&chain->graph, seed);
+  osc_set_graph(&chain->graph);
+
+  switch (looks[look].theta) {
+  case 1:
+    theta = new_osc_linear(
+      new_osc_wrap(0, 36000, 25),
+      new_osc_constant(2000));
+    break;
+  default:
+    theta = new_osc_linear(
+      new_osc_velowrap(0, 36000, new_osc_multiplex(
+	new_osc_randphaser(300, 600),
+	new_osc_constant(25),
+	new_osc_constant(75),
+	new_osc_constant(50),
+	new_osc_constant(100))
+      ),
+
+      new_osc_multiplex(
+	new_osc_buffer(new_osc_randphaser(300, 600)),
+	new_osc_buffer(new_osc_wrap(0, 36000, 10)),
+	new_osc_buffer(new_osc_wrap(0, 36000, -8)),
+	new_osc_wrap(0, 36000, 4),
+	new_osc_buffer(new_osc_bounce(-2000, 2000, 20))
+	)
+      );
+    break;
+  }
+
+  switch (looks[look].rad) {
+  case 1:
+    rad = new_osc_constant(1000);
+    break;
+  case 2:
+    /* As the default, but with a steady phaser, so that it repeats. */
+    rad = new_osc_buffer(new_osc_multiplex(
+      new_osc_phaser(300),
+      new_osc_bounce(-1000, 1000, 10),
+      new_osc_bounce(  200, 1000, -15),
+      new_osc_bounce(  400, 1000, 10),
+      new_osc_bounce(-1000, 1000, -20)));
+    break;
+  default:
+    rad = new_osc_buffer(new_osc_multiplex(
+      new_osc_randphaser(250, 500),
+      new_osc_bounce(-1000, 1000, 10),
+      new_osc_bounce(  200, 1000, -15),
+      new_osc_bounce(  400, 1000, 10),
+      new_osc_bounce(-1000, 1000, -20)));
+    break;
+  }
+
+  switch (looks[look].alti) {
+  case 1:
+    alti = new_osc_multiplex(
+      new_osc_buffer(new_osc_randphaser(60, 270)),
+      new_osc_buffer(new_osc_bounce(-1000, 1000, 48)),
+      new_osc_linear(
+	new_osc_constant(-1000),
+	new_osc_constant(2000 / NUM_ELS)),
+      new_osc_buffer(new_osc_bounce(-1000, 1000, 27)),
       new_osc_linear(
+	new_osc_constant(-1000),
+	new_osc_constant(2000 / NUM_ELS))
+      );
+    break;
+  default:
+    alti = new_osc_linear(
       new_osc_constant(-1000),
-      new_osc_constant(2000 / NUM_ELS))
-    );*/
-
-  /*color = new_osc_buffer(new_osc_randphaser(5, 35));*/
-
-  /*color = new_osc_buffer(new_osc_multiplex(
-    new_osc_randphaser(25, 70),
-    new_osc_wrap(0, 3600, 20),
-    new_osc_wrap(0, 3600, 30),
-    new_osc_wrap(0, 3600, -20),
-    new_osc_wrap(0, 3600, 10)));*/
-  color = new_osc_multiplex(
-    new_osc_buffer(new_osc_randphaser(150, 300)),
-    new_osc_buffer(new_osc_wrap(0, 3600, 13)),
-    new_osc_buffer(new_osc_wrap(0, 3600, 32)),
-    new_osc_buffer(new_osc_wrap(0, 3600, 17)),
-    new_osc_buffer(new_osc_wrap(0, 3600, 7)));
-
-  move_increment();
+      new_osc_constant(2000 / NUM_ELS));
+    break;
+  }
+
+  switch (looks[look].color) {
+  case 2:
+    /* A steady phaser again. */
+    color = new_osc_buffer(new_osc_multiplex(
+      new_osc_phaser(50),
+      new_osc_wrap(0, 3600, 20),
+      new_osc_wrap(0, 3600, 30),
+      new_osc_wrap(0, 3600, -20),
+      new_osc_wrap(0, 3600, 10)));
+    break;
+  case 1:
+    color = new_osc_buffer(new_osc_multiplex(
+      new_osc_randphaser(25, 70),
+      new_osc_wrap(0, 3600, 20),
+      new_osc_wrap(0, 3600, 30),
+      new_osc_wrap(0, 3600, -20),
+      new_osc_wrap(0, 3600, 10)));
+    break;
+  default:
+    color = new_osc_multiplex(
+      new_osc_buffer(new_osc_randphaser(150, 300)),
+      new_osc_buffer(new_osc_wrap(0, 3600, 13)),
+      new_osc_buffer(new_osc_wrap(0, 3600, 32)),
+      new_osc_buffer(new_osc_wrap(0, 3600, 17)),
+      new_osc_buffer(new_osc_wrap(0, 3600, 7)));
+    break;
+  }
+
+  osc_set_graph(NULL);
+  if (!theta || !rad || !alti || !color)
+    return FALSE;
+  chain->theta = theta;
+  chain->rad = rad;
+  chain->alti = alti;
+  chain->color = color;
+
+  chain_increment(chain);
+  memcpy(chain->prev, chain->cur, sizeof(chain->cur));
 
   return TRUE;
 }
@@ -107,20 +459,240 @@ void final_move()
 {
 }
 
-/* Set up the list of polygon data for rendering. */
+/* Advance the simulation by one step. */
 void move_increment()
+{
+  if (swap_building)
+    swap_check();
+
+  chain_increment(mainchain);
+  if (fading) {
+    chain_increment(fading);
+    fade_tick++;
+    if (fade_tick >= crossfade_ticks) {
+      free_chain(fading);
+      fading = NULL;
+    }
+  }
+  if (grid_count)
+    pool_run(grid_count, grid_increment_one, NULL);
+}
+
+/* Set up elist for rendering, somewhere between the last two simulation
+   steps. frac is 0.0 for the older one and 1.0 for the newer one. */
+void move_interpolate(GLfloat frac)
+{
+  chain_interpolate(mainchain, elist, frac);
+  if (fading) {
+    /* Each polygon slides from where the old chain has it to where the
+       new one does. */
+    GLfloat weight = (fade_tick + frac) / crossfade_ticks;
+    int ix, jx;
+    chain_interpolate(fading, fade_list, frac);
+    if (weight > 1.0)
+      weight = 1.0;
+    for (ix=0; ix<NUM_ELS; ix++) {
+      elem_t *el = &elist[ix];
+      elem_t *el0 = &fade_list[ix];
+      for (jx=0; jx<3; jx++)
+	el->pos[jx] = el0->pos[jx] + weight * (el->pos[jx] - el0->pos[jx]);
+      for (jx=0; jx<4; jx++)
+	el->col[jx] = el0->col[jx] + weight * (el->col[jx] - el0->col[jx]);
+    }
+  }
+  if (grid_count) {
+    grid_frac = frac;
+    pool_run(grid_count, grid_interpolate_one, NULL);
+  }
+}
+
+static void grid_increment_one(int ix, void *rock)
+{
+  chain_increment(&grid[ix]);
+}
+
+static void grid_interpolate_one(int ix, void *rock)
+{
+  chain_interpolate(&grid[ix], &grid_elist[ix*NUM_ELS], grid_frac);
+}
+
+/* Save the state of every chain: the main one, and the grid. */
+void move_save(FILE *fl)
+{
+  int ix;
+
+  state_put(fl, 1 + grid_count);
+  chain_save(mainchain, fl);
+  for (ix=0; ix<grid_count; ix++)
+    chain_save(&grid[ix], fl);
+}
+
+/* Load it back. The frame each chain was showing comes back too, so the
+   next step is the one the saved run would have taken next. */
+int move_load(FILE *fl)
+{
+  int ix, count;
+
+  if (!state_get(fl, &count) || count != 1 + grid_count)
+    return FALSE;
+  if (!chain_load(mainchain, fl))
+    return FALSE;
+  for (ix=0; ix<grid_count; ix++) {
+    if (!chain_load(&grid[ix], fl))
+      return FALSE;
+  }
+
+  chain_loop(mainchain, 0);
+  memcpy(elist, mainchain->cur, sizeof(elist));
+  for (ix=0; ix<grid_count; ix++)
+    memcpy(&grid_elist[ix*NUM_ELS], grid[ix].cur, sizeof(grid[ix].cur));
+  return TRUE;
+}
+
+/* Save one chain: its look first, since that says what shape its graph
+   is, then the graph, then the polygons of the current step. The graph
+   is already one step past those (chain_increment() computes a step,
+   then moves the graph on), and there's no stepping it back, so the
+   polygons have to be saved as they are. They go out as the bits of
+   each float. */
+void chain_save(chain_t *chain, FILE *fl)
+{
+  int ix;
+
+  state_put(fl, chain->look);
+  chain_sync(chain);
+  osc_save(&chain->graph, fl);
+  for (ix=0; ix<NUM_ELS; ix++)
+    put_floats(fl, (GLfloat *)&chain->cur[ix], ELEM_FLOATS);
+}
+
+/* Load a chain saved by chain_save(), rebuilding it with a different
+   look if need be. The loaded step is both the current and the previous
+   one, as after init_chain(). */
+int chain_load(chain_t *chain, FILE *fl)
+{
+  int ix, look;
+
+  if (!state_get(fl, &look) || !reshape_chain(chain, look)
+    || !osc_load(&chain->graph, fl))
+    return FALSE;
+  for (ix=0; ix<NUM_ELS; ix++) {
+    if (!get_floats(fl, (GLfloat *)&chain->cur[ix], ELEM_FLOATS))
+      return FALSE;
+  }
+  memcpy(chain->prev, chain->cur, sizeof(chain->cur));
+  return TRUE;
+}
+
+/* Rebuild a chain with a different look, if need be, so that a saved
+   state can be loaded into it. */
+static int reshape_chain(chain_t *chain, int look)
+{
+  if (look < 0 || look >= NUM_LOOKS)
+    return FALSE;
+  free(chain->loop);
+  chain->loop = NULL;
+  if (chain->look == look)
+    return TRUE;
+  osc_free_graph(&chain->graph);
+  return init_chain(chain, 0, look);
+}
+
+static void put_floats(FILE *fl, GLfloat *vals, int count)
+{
+  int ix, bits;
+
+  for (ix=0; ix<count; ix++) {
+    memcpy(&bits, &vals[ix], sizeof(bits));
+    state_put(fl, bits);
+  }
+}
+
+static int get_floats(FILE *fl, GLfloat *vals, int count)
+{
+  int ix, bits;
+
+  for (ix=0; ix<count; ix++) {
+    if (!state_get(fl, &bits))
+      return FALSE;
+    memcpy(&vals[ix], &bits, sizeof(bits));
+  }
+  return TRUE;
+}
+
+void chain_increment(chain_t *chain)
+{
+  memcpy(chain->prev, chain->cur, sizeof(chain->cur));
+  if (chain->loop) {
+    memcpy(chain->cur, &chain->loop[chain->loop_pos * NUM_ELS],
+      sizeof(chain->cur));
+    chain->loop_pos = (chain->loop_pos + 1) % chain->loop_len;
+    /* A whole cycle behind is no behind at all. */
+    chain->loop_lag = (chain->loop_lag + 1) % chain->loop_len;
+    return;
+  }
+  compute_elist(chain, chain->cur);
+  osc_increment(&chain->graph);
+}
+
+void chain_interpolate(chain_t *chain, elem_t *list, GLfloat frac)
+{
+  int ix, jx;
+
+  if (frac >= 1.0) {
+    memcpy(list, chain->cur, sizeof(chain->cur));
+    return;
+  }
+  if (frac < 0.0)
+    frac = 0.0;
+
+  for (ix=0; ix<NUM_ELS; ix++) {
+    elem_t *el = &list[ix];
+    elem_t *el0 = &chain->prev[ix];
+    elem_t *el1 = &chain->cur[ix];
+
+    for (jx=0; jx<3; jx++)
+      el->pos[jx] = el0->pos[jx] + frac * (el1->pos[jx] - el0->pos[jx]);
+    el->vervec[0] = el1->vervec[0];
+    el->vervec[1] = el1->vervec[1];
+    /* The color wheel is continuous in RGB, so blending RGB is fine even
+       when the hue wraps around. */
+    for (jx=0; jx<4; jx++)
+      el->col[jx] = el0->col[jx] + frac * (el1->col[jx] - el0->col[jx]);
+  }
+}
+
+/* Set up a list of polygon data from the current state of a chain's osc_t
+   functions. */
+static void compute_elist(chain_t *chain, elem_t *list)
 {
   int ix, val;
   GLfloat pt[2];
   GLfloat ptrad, pttheta;
+  int theta[NUM_ELS], rad[NUM_ELS], alti[NUM_ELS], color[NUM_ELS];
+
+  if (elist_blocks) {
+    osc_get_block(chain->theta, theta);
+    osc_get_block(chain->rad, rad);
+    osc_get_block(chain->alti, alti);
+    osc_get_block(chain->color, color);
+  }
+  else {
+    for (ix=0; ix<NUM_ELS; ix++) {
+      theta[ix] = osc_get(chain->theta, ix);
+      rad[ix] = osc_get(chain->rad, ix);
+      alti[ix] = osc_get(chain->alti, ix);
+      color[ix] = osc_get(chain->color, ix);
+    }
+  }
 
   for (ix=0; ix<NUM_ELS; ix++) {
-    elem_t *el = &elist[ix];
+    elem_t *el = &list[ix];
 
     /* Grab r and theta... */
-    val = osc_get(theta, ix);
+    val = theta[ix];
     pttheta = val * (0.01 * M_PI / 180.0);
-    ptrad = (GLfloat)osc_get(rad, ix) * 0.001;
+    ptrad = (GLfloat)rad[ix] * 0.001;
     /* And convert them to x,y coordinates. */
     pt[0] = ptrad * cos(pttheta);
     pt[1] = ptrad * sin(pttheta);
@@ -128,7 +700,7 @@ void move_increment()
     /* Set x,y,z. */
     el->pos[0] = pt[0];
     el->pos[1] = pt[1];
-    el->pos[2] = (GLfloat)osc_get(alti, ix) * 0.001;
+    el->pos[2] = (GLfloat)alti[ix] * 0.001;
 
     /* Set which way the square is rotated. This is fixed for now, although
        it would be trivial to make the squares spin as they revolve. */
@@ -137,7 +709,7 @@ void move_increment()
 
     /* Grab the color, and convert it to RGB values. Technically, we're
        converting an HSV value to RGB, where S and V are always 1. */
-    val = osc_get(color, ix);
+    val = color[ix];
     if (val < 1200) {
       el->col[0] = ((GLfloat)val / 1200.0);
       el->col[1] = 0;
@@ -155,7 +727,5 @@ void move_increment()
     }
     el->col[3] = 1.0;
   }
-
-  osc_increment();
 }
 
@@ -11,8 +11,47 @@ typedef struct elem_struct {
   GLfloat col[4];
 } elem_t;
 
+/* A chain is one whole universe: an osc_t graph, the four parameters
+   built from it, and the polygons from its last two simulation steps. */
+typedef struct chain_struct {
+  int look; /* which variety of graph this is; see move.c */
+  oscgraph_t graph;
+  osc_t *theta, *rad, *alti, *color;
+  elem_t prev[NUM_ELS];
+  elem_t cur[NUM_ELS];
+  /* With --loop-cache, a periodic chain keeps every step of one cycle
+     here and replays them, and the graph stands still (see
+     chain_loop()). */
+  elem_t *loop; /* loop_len steps of NUM_ELS, or NULL */
+  unsigned long loop_len;
+  unsigned long loop_pos; /* the step that comes next */
+  unsigned long loop_lag; /* how many steps the graph is behind */
+} chain_t;
+
 extern elem_t elist[];
 
+/* In grid mode, there are grid_cols*grid_rows more chains, and
+   grid_elist holds NUM_ELS polygons for each, row by row. */
+extern int grid_cols, grid_rows;
+extern elem_t *grid_elist;
+
 extern int init_move(void);
 extern void final_move(void);
 extern void move_increment(void);
+extern void move_interpolate(GLfloat frac);
+extern void move_save(FILE *fl);
+extern int move_load(FILE *fl);
+
+extern int elist_blocks;
+extern int move_look;
+extern int crossfade_ticks;
+extern int loop_cache_mb;
+extern int move_find_look(char *name);
+extern char *move_look_name(int look);
+extern void move_swap(int look);
+
+extern int init_chain(chain_t *chain, unsigned int seed, int look);
+extern void chain_increment(chain_t *chain);
+extern void chain_interpolate(chain_t *chain, elem_t *list, GLfloat frac);
+extern void chain_save(chain_t *chain, FILE *fl);
+extern int chain_load(chain_t *chain, FILE *fl);
@@ -7,15 +7,58 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "general.h"
 #include "osc.h"
+#include "state.h"
 
-/* A private linked list of all osc_t objects created. New objects are added
-   to the end of the list, not the beginning. */
-static osc_t *oscroot = NULL;
-static osc_t **osctail = &oscroot;
+/* The graph that new osc_t objects are added to. Each graph keeps a
+   linked list of its objects; new objects are added to the end of the
+   list, not the beginning. Each thread has its own, so different threads
+   can build different graphs at once. */
+static __thread oscgraph_t *curgraph = NULL;
 
-static int rand_range(int min, int max);
+static int rand_range(oscgraph_t *graph, int min, int max);
+static unsigned long long gcd(unsigned long long a, unsigned long long b);
+static void plan_graph(oscgraph_t *graph);
+static void catch_up(osc_t *osc);
+static void advance(osc_t *osc, unsigned long count);
+static void step_bounce(struct obounce_struct *ox);
+static void step_wrap(struct owrap_struct *ox);
+static void step_phaser(struct ophaser_struct *ox);
+static void buffer_push(struct obuffer_struct *ox, int val);
+static void osc_range(osc_t *osc, int *min, int *max);
+static int load_ok(osc_t *osc);
+
+void osc_init_graph(oscgraph_t *graph, unsigned int seed)
+{
+  graph->root = NULL;
+  graph->tail = &graph->root;
+  graph->seed = seed;
+  graph->tick = 0;
+  graph->steps = NULL;
+  graph->planned = FALSE;
+}
+
+void osc_set_graph(oscgraph_t *graph)
+{
+  curgraph = graph;
+}
+
+/* Throw away every osc_t in a graph. */
+void osc_free_graph(oscgraph_t *graph)
+{
+  osc_t *osc, *next;
+
+  for (osc = graph->root; osc; osc = next) {
+    next = osc->next;
+    free(osc);
+  }
+  graph->root = NULL;
+  graph->tail = &graph->root;
+  graph->steps = NULL;
+  graph->planned = FALSE;
+}
 
 /* Create a new, blank osc_t. The caller must fill in the type data. */
 static osc_t *create_osc(int type)
@@ -26,9 +69,14 @@ static osc_t *create_osc(int type)
         
   osc->type = type;
   osc->next = NULL;
+  osc->graph = curgraph;
+  osc->stamp = curgraph->tick;
+  osc->nextstep = NULL;
+  osc->owner = NULL;
+  osc->readers = 0;
     
-  *osctail = osc;
-  osctail = &(osc->next);
+  *curgraph->tail = osc;
+  curgraph->tail = &(osc->next);
     
   return osc;
 }
@@ -61,7 +109,7 @@ osc_t *new_osc_bounce(int min, int max, int step)
   if (step < 0)
     step = (-step);
   diff = (max-min) / step;
-  osc->u.obounce.val = min + step * rand_range(0, diff-1);
+  osc->u.obounce.val = min + step * rand_range(curgraph, 0, diff-1);
     
   return osc;
 }
@@ -81,7 +129,7 @@ osc_t *new_osc_wrap(int min, int max, int step)
   if (step < 0)
     step = (-step);
   diff = (max-min) / step;
-  osc->u.owrap.val = min + step * rand_range(0, diff-1);
+  osc->u.owrap.val = min + step * rand_range(curgraph, 0, diff-1);
     
   return osc;
 }
@@ -97,7 +145,7 @@ osc_t *new_osc_velowrap(int min, int max, osc_t *step)
   osc->u.ovelowrap.step = step;
     
   /* Pick a random initial value between min and max. */
-  osc->u.ovelowrap.val = rand_range(min, max);
+  osc->u.ovelowrap.val = rand_range(curgraph, min, max);
     
   return osc;
 }
@@ -127,7 +175,7 @@ osc_t *new_osc_phaser(int phaselen)
 
   osc->u.ophaser.count = 0;
   /* Pick a random phase to start in. */
-  osc->u.ophaser.curphase = rand_range(0, NUM_PHASES-1);
+  osc->u.ophaser.curphase = rand_range(curgraph, 0, NUM_PHASES-1);
 
   return osc;
 }
@@ -143,9 +191,10 @@ osc_t *new_osc_randphaser(int minphaselen, int maxphaselen)
 
   osc->u.orandphaser.count = 0;
   /* Pick a random phaselen to start with. */
-  osc->u.orandphaser.curphaselen = rand_range(minphaselen, maxphaselen);
+  osc->u.orandphaser.curphaselen = rand_range(curgraph,
+    minphaselen, maxphaselen);
   /* Pick a random phase to start in. */
-  osc->u.orandphaser.curphase = rand_range(0, NUM_PHASES-1);
+  osc->u.orandphaser.curphase = rand_range(curgraph, 0, NUM_PHASES-1);
 
   return osc;
 }
@@ -171,12 +220,29 @@ osc_t *new_osc_buffer(osc_t *val)
     
   osc->u.obuffer.val = val;
   osc->u.obuffer.firstel = NUM_ELS-1;
+
+#ifdef OSC_COMPACT
+  {
+    int min, max;
+    osc_range(val, &min, &max);
+    if (max - min > 0xFFFF) {
+      fprintf(stderr, "osc: buffered values from %d to %d won't fit in "
+	"16 bits\n", min, max);
+      exit(1);
+    }
+    osc->u.obuffer.bias = min;
+  }
     
-  /* The last N values are stored in a ring buffer, which we must initialize
-     here. */
-  for (ix=0; ix<NUM_ELS; ix++) {
+  for (ix=0; ix<2*NUM_ELS; ix++) {
+    osc->u.obuffer.el[ix] = osc_get(val, 0) - osc->u.obuffer.bias;
+  }
+#else
+  /* The last N values are stored in a ring buffer (twice over), which we
+     must initialize here. */
+  for (ix=0; ix<2*NUM_ELS; ix++) {
     osc->u.obuffer.el[ix] = osc_get(val, 0);
   }
+#endif
 
   return osc;
 }
@@ -193,9 +259,13 @@ int osc_get(osc_t *osc, int el)
     return osc->u.oconstant.val;
             
   case otyp_Bounce:
+    if (osc->stamp != osc->graph->tick)
+      catch_up(osc);
     return osc->u.obounce.val;
             
   case otyp_Wrap:
+    if (osc->stamp != osc->graph->tick)
+      catch_up(osc);
     return osc->u.owrap.val;
         
   case otyp_VeloWrap:
@@ -213,6 +283,8 @@ int osc_get(osc_t *osc, int el)
         
   case otyp_Phaser: {
     struct ophaser_struct *ox = &(osc->u.ophaser);
+    if (osc->stamp != osc->graph->tick)
+      catch_up(osc);
     return ox->curphase;
   }
         
@@ -223,7 +295,13 @@ int osc_get(osc_t *osc, int el)
         
   case otyp_Buffer: {
     struct obuffer_struct *ox = &(osc->u.obuffer);
-    return ox->el[(ox->firstel + el) % NUM_ELS];
+    if (osc->stamp != osc->graph->tick)
+      catch_up(osc);
+#ifdef OSC_COMPACT
+    return ox->bias + ox->el[ox->firstel + el];
+#else
+    return ox->el[ox->firstel + el];
+#endif
   }
         
   default:
@@ -231,40 +309,95 @@ int osc_get(osc_t *osc, int el)
   }
 }
 
-/* Increment i. This affects all osc_t objects; we go down the linked list to
-   get them all. */
-void osc_increment()
+/* Compute the whole current N-tuple at once: vals[el] = osc_get(osc, el)
+   for each el. This is the same as calling osc_get() NUM_ELS times, but a
+   Buffer's window comes out in one copy, and Linear and Multiplex nodes
+   work on whole blocks of their inputs. */
+void osc_get_block(osc_t *osc, int *vals)
+{
+  int ix;
+
+  if (!osc) {
+    memset(vals, 0, NUM_ELS * sizeof(int));
+    return;
+  }
+
+  switch (osc->type) {
+
+  case otyp_Linear: {
+    int diff[NUM_ELS];
+    osc_get_block(osc->u.olinear.base, vals);
+    osc_get_block(osc->u.olinear.diff, diff);
+    for (ix=0; ix<NUM_ELS; ix++)
+      vals[ix] += ix * diff[ix];
+    return;
+  }
+
+  case otyp_Multiplex: {
+    struct omultiplex_struct *ox = &(osc->u.omultiplex);
+    int sel[NUM_ELS];
+    osc_get_block(ox->sel, sel);
+    for (ix=1; ix<NUM_ELS; ix++) {
+      if (sel[ix] % NUM_PHASES != sel[0] % NUM_PHASES)
+	break;
+    }
+    if (ix == NUM_ELS) {
+      /* The usual case: one branch for the whole tuple. */
+      osc_get_block(ox->val[sel[0] % NUM_PHASES], vals);
+      return;
+    }
+    for (ix=0; ix<NUM_ELS; ix++)
+      vals[ix] = osc_get(ox->val[sel[ix] % NUM_PHASES], ix);
+    return;
+  }
+
+  case otyp_Buffer: {
+    struct obuffer_struct *ox = &(osc->u.obuffer);
+    if (osc->stamp != osc->graph->tick)
+      catch_up(osc);
+#ifdef OSC_COMPACT
+    /* Widen as we go; see osc.h. */
+    for (ix=0; ix<NUM_ELS; ix++)
+      vals[ix] = ox->bias + ox->el[ox->firstel + ix];
+#else
+    memcpy(vals, &ox->el[ox->firstel], NUM_ELS * sizeof(int));
+#endif
+    return;
+  }
+
+  default: {
+    /* Everything else is the same for every el. */
+    int val = osc_get(osc, 0);
+    for (ix=0; ix<NUM_ELS; ix++)
+      vals[ix] = val;
+    return;
+  }
+  }
+}
+
+/* Increment i. This affects all osc_t objects in the graph, but most of
+   them don't need stepping every time. Constant, Linear, and Multiplex
+   have no state of their own. Wrap, Bounce, and Phaser depend on nothing
+   but themselves, so they can wait until someone reads them, and then
+   catch up all at once. (In a Multiplex, the branches that aren't
+   selected may not be read for hundreds of ticks.) A Buffer of one of
+   those can wait too, as long as nothing else reads its source.
+
+   That leaves VeloWrap and RandPhaser -- one reads another node every
+   step, the other draws from the graph's random stream, whose order
+   must not change -- and the other Buffers. Those we step every time,
+   in creation order, which is the list plan_graph() makes. */
+void osc_increment(oscgraph_t *graph)
 {
   osc_t *osc;
+
+  if (!graph->planned)
+    plan_graph(graph);
+  graph->tick++;
     
-  for (osc = oscroot; osc; osc = osc->next) {
+  for (osc = graph->steps; osc; osc = osc->nextstep) {
+    osc->stamp = graph->tick;
     switch (osc->type) {
-        
-    case otyp_Bounce: {
-      struct obounce_struct *ox = &(osc->u.obounce);
-      ox->val += ox->step;
-      if (ox->val < ox->min && ox->step < 0) {
-	ox->step = -(ox->step);
-	ox->val = ox->min + (ox->min - ox->val);
-      }
-      if (ox->val > ox->max && ox->step > 0) {
-	ox->step = -(ox->step);
-	ox->val = ox->max + (ox->max - ox->val);
-      }
-      break;
-    }
-                
-    case otyp_Wrap: {
-      struct owrap_struct *ox = &(osc->u.owrap);
-      ox->val += ox->step;
-      if (ox->val < ox->min && ox->step < 0) {
-	ox->val += (ox->max - ox->min);
-      }
-      if (ox->val > ox->max && ox->step > 0) {
-	ox->val -= (ox->max - ox->min);
-      }
-      break;
-    }
             
     case otyp_VeloWrap: {
       struct ovelowrap_struct *ox = &(osc->u.ovelowrap);
@@ -277,24 +410,12 @@ void osc_increment()
       break;
     }
             
-    case otyp_Phaser: {
-      struct ophaser_struct *ox = &(osc->u.ophaser);
-      ox->count++;
-      if (ox->count >= ox->phaselen) {
-	ox->count = 0;
-	ox->curphase++;
-	if (ox->curphase >= NUM_PHASES)
-	  ox->curphase = 0;
-      }
-      break;
-    }
-            
     case otyp_RandPhaser: {
       struct orandphaser_struct *ox = &(osc->u.orandphaser);
       ox->count++;
       if (ox->count >= ox->curphaselen) {
 	ox->count = 0;
-	ox->curphaselen = rand_range(ox->minphaselen, ox->maxphaselen);
+	ox->curphaselen = rand_range(graph, ox->minphaselen, ox->maxphaselen);
 	ox->curphase++;
 	if (ox->curphase >= NUM_PHASES)
 	  ox->curphase = 0;
@@ -302,32 +423,573 @@ void osc_increment()
       break;
     }
             
+    case otyp_Buffer:
+      /* ox->val is up to date by the time we read it: either it's
+	 stepped on its own, earlier in this list, or it catches up when
+	 read. */
+      buffer_push(&(osc->u.obuffer), osc_get(osc->u.obuffer.val, 0));
+      break;
+            
+    default:
+      break;
+    }
+  }
+}
+
+/* Work out which nodes osc_increment() steps every time. This happens at
+   the first increment, when the graph is finished. */
+static void plan_graph(oscgraph_t *graph)
+{
+  osc_t *osc, **tail;
+  int ix;
+
+  for (osc = graph->root; osc; osc = osc->next) {
+    switch (osc->type) {
+    case otyp_VeloWrap:
+      if (osc->u.ovelowrap.step)
+	osc->u.ovelowrap.step->readers++;
+      break;
+    case otyp_Linear:
+      if (osc->u.olinear.base)
+	osc->u.olinear.base->readers++;
+      if (osc->u.olinear.diff)
+	osc->u.olinear.diff->readers++;
+      break;
+    case otyp_Multiplex:
+      if (osc->u.omultiplex.sel)
+	osc->u.omultiplex.sel->readers++;
+      for (ix=0; ix<NUM_PHASES; ix++) {
+	if (osc->u.omultiplex.val[ix])
+	  osc->u.omultiplex.val[ix]->readers++;
+      }
+      break;
+    case otyp_Buffer:
+      if (osc->u.obuffer.val)
+	osc->u.obuffer.val->readers++;
+      break;
+    default:
+      break;
+    }
+  }
+
+  tail = &graph->steps;
+  for (osc = graph->root; osc; osc = osc->next) {
+    switch (osc->type) {
+    case otyp_Buffer: {
+      osc_t *val = osc->u.obuffer.val;
+      if (val && val->readers == 1 && (val->type == otyp_Wrap
+	  || val->type == otyp_Bounce || val->type == otyp_Phaser)) {
+	/* Nobody else reads val, so the Buffer steps it as it catches
+	   up. */
+	val->owner = osc;
+	break;
+      }
+      /* Otherwise, step it every time. */
+    }
+    case otyp_VeloWrap:
+    case otyp_RandPhaser:
+      *tail = osc;
+      tail = &(osc->nextstep);
+      break;
+    default:
+      break;
+    }
+  }
+  *tail = NULL;
+
+  graph->planned = TRUE;
+}
+
+/* Bring a node that was left behind up to the current tick. A node
+   with an owner is brought along by its owner. */
+static void catch_up(osc_t *osc)
+{
+  unsigned long behind;
+
+  if (osc->owner)
+    osc = osc->owner;
+  behind = osc->graph->tick - osc->stamp;
+  if (!behind)
+    return;
+
+  if (osc->type == otyp_Buffer) {
+    struct obuffer_struct *ox = &(osc->u.obuffer);
+    osc_t *val = ox->val;
+    if (behind > NUM_ELS) {
+      /* All but the last NUM_ELS values would be pushed out of the ring
+	 anyway; skip them. */
+      unsigned long skip = behind - NUM_ELS;
+      advance(val, skip);
+      ox->firstel = (int)((ox->firstel + NUM_ELS - skip % NUM_ELS)
+	% NUM_ELS);
+      behind = NUM_ELS;
+    }
+    osc->stamp = osc->graph->tick;
+    while (behind--) {
+      advance(val, 1);
+      switch (val->type) {
+      case otyp_Bounce:
+	buffer_push(ox, val->u.obounce.val);
+	break;
+      case otyp_Wrap:
+	buffer_push(ox, val->u.owrap.val);
+	break;
+      case otyp_Phaser:
+	buffer_push(ox, val->u.ophaser.curphase);
+	break;
+      }
+    }
+    return;
+  }
+
+  advance(osc, behind);
+}
+
+/* Step a Wrap, Bounce, or Phaser count times. Where the state is the kind
+   that stepping produces, there's a closed form; otherwise (a state file
+   from somewhere odd, say) we just step it over and over. */
+static void advance(osc_t *osc, unsigned long count)
+{
+  osc->stamp += count;
+
+  switch (osc->type) {
+
+  case otyp_Bounce: {
+    /* Unfold the bouncing into a wrap over twice the range: going up,
+       pos runs from 0 to range; going down, it runs on from range to
+       2*range, while val runs back down. */
+    struct obounce_struct *ox = &(osc->u.obounce);
+    long long range = (long long)ox->max - ox->min;
+    long long val = (long long)ox->val - ox->min;
+    long long speed = (ox->step < 0) ? -(long long)ox->step : ox->step;
+    long long pos;
+    if (range > 0 && speed > 0 && speed <= range && val >= 0
+      && (ox->step > 0 ? val <= range : val < range)) {
+      pos = (ox->step > 0) ? val : 2*range - val;
+      pos = (pos + (long long)count * speed - 1) % (2*range) + 1;
+      if (pos <= range) {
+	ox->step = speed;
+	ox->val = ox->min + pos;
+      }
+      else {
+	ox->step = -speed;
+	ox->val = ox->min + (2*range - pos);
+      }
+      return;
+    }
+    while (count--)
+      step_bounce(ox);
+    return;
+  }
+
+  case otyp_Wrap: {
+    struct owrap_struct *ox = &(osc->u.owrap);
+    long long range = (long long)ox->max - ox->min;
+    long long val = (long long)ox->val - ox->min;
+    long long step = ox->step;
+    if (range > 0 && step != 0 && step <= range && -step <= range
+      && val >= 0 && val <= range) {
+      /* Going up, values run from min+1 to max; going down, from min to
+	 max-1. */
+      if (step > 0)
+	val = (val + (long long)count * step - 1) % range + 1;
+      else {
+	val = (val + (long long)count * step) % range;
+	if (val < 0)
+	  val += range;
+      }
+      ox->val = ox->min + val;
+      return;
+    }
+    while (count--)
+      step_wrap(ox);
+    return;
+  }
+
+  case otyp_Phaser: {
+    struct ophaser_struct *ox = &(osc->u.ophaser);
+    if (ox->phaselen > 0 && ox->count >= 0 && ox->count < ox->phaselen
+      && ox->curphase >= 0 && ox->curphase < NUM_PHASES) {
+      unsigned long long total = (unsigned long long)ox->count + count;
+      ox->count = total % ox->phaselen;
+      ox->curphase = (ox->curphase + total / ox->phaselen) % NUM_PHASES;
+      return;
+    }
+    while (count--)
+      step_phaser(ox);
+    return;
+  }
+
+  default:
+    return;
+  }
+}
+
+/* One step of each of the lazy kinds, as osc_increment() used to do
+   them. */
+
+static void step_bounce(struct obounce_struct *ox)
+{
+  ox->val += ox->step;
+  if (ox->val < ox->min && ox->step < 0) {
+    ox->step = -(ox->step);
+    ox->val = ox->min + (ox->min - ox->val);
+  }
+  if (ox->val > ox->max && ox->step > 0) {
+    ox->step = -(ox->step);
+    ox->val = ox->max + (ox->max - ox->val);
+  }
+}
+
+static void step_wrap(struct owrap_struct *ox)
+{
+  ox->val += ox->step;
+  if (ox->val < ox->min && ox->step < 0) {
+    ox->val += (ox->max - ox->min);
+  }
+  if (ox->val > ox->max && ox->step > 0) {
+    ox->val -= (ox->max - ox->min);
+  }
+}
+
+static void step_phaser(struct ophaser_struct *ox)
+{
+  ox->count++;
+  if (ox->count >= ox->phaselen) {
+    ox->count = 0;
+    ox->curphase++;
+    if (ox->curphase >= NUM_PHASES)
+      ox->curphase = 0;
+  }
+}
+
+/* Push a new current value onto a Buffer's ring, in both copies. */
+static void buffer_push(struct obuffer_struct *ox, int val)
+{
+  ox->firstel--;
+  if (ox->firstel < 0)
+    ox->firstel += NUM_ELS;
+#ifdef OSC_COMPACT
+  ox->el[ox->firstel] = ox->el[ox->firstel + NUM_ELS] = val - ox->bias;
+#else
+  ox->el[ox->firstel] = ox->el[ox->firstel + NUM_ELS] = val;
+#endif
+}
+
+/* Write out everything about a graph that changes as it runs: the random
+   seed, and each node's counters and values, in creation order. Buffer
+   rings go out oldest-last, starting from the current value, which is
+   the same however the ring is stored. */
+void osc_save(oscgraph_t *graph, FILE *fl)
+{
+  osc_t *osc;
+  int count = 0, ix;
+
+  for (osc = graph->root; osc; osc = osc->next)
+    count++;
+  state_put(fl, (int)graph->seed);
+  state_put(fl, count);
+
+  for (osc = graph->root; osc; osc = osc->next) {
+    /* Anything that's fallen behind has to catch up first. */
+    catch_up(osc);
+    state_put(fl, osc->type);
+    switch (osc->type) {
+    case otyp_Bounce:
+      state_put(fl, osc->u.obounce.step);
+      state_put(fl, osc->u.obounce.val);
+      break;
+    case otyp_Wrap:
+      state_put(fl, osc->u.owrap.val);
+      break;
+    case otyp_VeloWrap:
+      state_put(fl, osc->u.ovelowrap.val);
+      break;
+    case otyp_Phaser:
+      state_put(fl, osc->u.ophaser.count);
+      state_put(fl, osc->u.ophaser.curphase);
+      break;
+    case otyp_RandPhaser:
+      state_put(fl, osc->u.orandphaser.count);
+      state_put(fl, osc->u.orandphaser.curphaselen);
+      state_put(fl, osc->u.orandphaser.curphase);
+      break;
+    case otyp_Buffer:
+      for (ix=0; ix<NUM_ELS; ix++)
+	state_put(fl, osc_get(osc, ix));
+      break;
+    default:
+      /* Nothing changes. */
+      break;
+    }
+  }
+}
+
+/* Read back what osc_save() wrote, into a graph built the same way.
+   Returns FALSE if the file doesn't match the graph, or holds a state
+   that stepping the graph could never reach; in that case the graph may
+   be partly overwritten. */
+int osc_load(oscgraph_t *graph, FILE *fl)
+{
+  osc_t *osc;
+  int count = 0, seed, ix, val;
+
+  for (osc = graph->root; osc; osc = osc->next)
+    count++;
+  if (!state_get(fl, &seed) || !state_get(fl, &val) || val != count)
+    return FALSE;
+  graph->seed = (unsigned int)seed;
+
+  for (osc = graph->root; osc; osc = osc->next) {
+    osc->stamp = graph->tick;
+    if (!state_get(fl, &val) || val != osc->type)
+      return FALSE;
+    switch (osc->type) {
+    case otyp_Bounce: {
+      /* The step may have turned around, but not changed size. */
+      int speed = abs(osc->u.obounce.step);
+      if (!state_get(fl, &osc->u.obounce.step)
+	|| !state_get(fl, &osc->u.obounce.val)
+	|| abs(osc->u.obounce.step) != speed)
+	return FALSE;
+      break;
+    }
+    case otyp_Wrap:
+      if (!state_get(fl, &osc->u.owrap.val))
+	return FALSE;
+      break;
+    case otyp_VeloWrap:
+      if (!state_get(fl, &osc->u.ovelowrap.val))
+	return FALSE;
+      break;
+    case otyp_Phaser:
+      if (!state_get(fl, &osc->u.ophaser.count)
+	|| !state_get(fl, &osc->u.ophaser.curphase))
+	return FALSE;
+      break;
+    case otyp_RandPhaser:
+      if (!state_get(fl, &osc->u.orandphaser.count)
+	|| !state_get(fl, &osc->u.orandphaser.curphaselen)
+	|| !state_get(fl, &osc->u.orandphaser.curphase))
+	return FALSE;
+      break;
     case otyp_Buffer: {
       struct obuffer_struct *ox = &(osc->u.obuffer);
-      ox->firstel--;
-      if (ox->firstel < 0)
-	ox->firstel += NUM_ELS;
-      ox->el[ox->firstel] = osc_get(ox->val, 0);
-      /* We can assume that ox->val has already been incremented, since it
-	 was created first. This is why new objects are put on the end
-	 of the linked list... yeah, it's gross. */
+      int min, max;
+      /* Whatever reads the ring (a Multiplex selector, say) may count on
+	 the values being ones its source can produce. */
+      osc_range(ox->val, &min, &max);
+      ox->firstel = 0;
+      for (ix=0; ix<NUM_ELS; ix++) {
+	if (!state_get(fl, &val) || val < min || val > max)
+	  return FALSE;
+#ifdef OSC_COMPACT
+	ox->el[ix] = ox->el[ix + NUM_ELS] = val - ox->bias;
+#else
+	ox->el[ix] = ox->el[ix + NUM_ELS] = val;
+#endif
+      }
       break;
     }
-            
     default:
       break;
     }
+    if (!load_ok(osc))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Check that a node just loaded is in a state that stepping could have
+   left it in. The catch-up in advance() counts on that, and so does
+   Multiplex, which indexes by a phase. */
+static int load_ok(osc_t *osc)
+{
+  switch (osc->type) {
+  case otyp_Bounce: {
+    struct obounce_struct *ox = &(osc->u.obounce);
+    return (ox->val >= ox->min && ox->val <= ox->max);
+  }
+  case otyp_Wrap: {
+    struct owrap_struct *ox = &(osc->u.owrap);
+    return (ox->val >= ox->min && ox->val <= ox->max);
+  }
+  case otyp_VeloWrap: {
+    struct ovelowrap_struct *ox = &(osc->u.ovelowrap);
+    return (ox->val >= ox->min && ox->val <= ox->max);
+  }
+  case otyp_Phaser: {
+    struct ophaser_struct *ox = &(osc->u.ophaser);
+    return (ox->count >= 0 && ox->count < ox->phaselen
+      && ox->curphase >= 0 && ox->curphase < NUM_PHASES);
+  }
+  case otyp_RandPhaser: {
+    struct orandphaser_struct *ox = &(osc->u.orandphaser);
+    return (ox->curphaselen >= ox->minphaselen
+      && ox->curphaselen <= ox->maxphaselen
+      && ox->count >= 0 && ox->count < ox->curphaselen
+      && ox->curphase >= 0 && ox->curphase < NUM_PHASES);
+  }
+  default:
+    return TRUE;
+  }
+}
+
+/* How many increments it takes a graph to come back around to the state
+   it's in now, or 0 if it never does, or not within limit increments.
+
+   A graph with a RandPhaser in it never repeats, and neither (as far as
+   we can tell) does one with a VeloWrap. Otherwise, each Wrap, Bounce,
+   and Phaser has a period that follows from its range and step, and the
+   graph's is the least common multiple of them all; Constant, Linear,
+   and Multiplex have no state to repeat. A Buffer repeats with its
+   source, but only once it's full of values from the cycle -- NUM_ELS
+   increments in, from a fresh start. This also assumes every node is in
+   the kind of state that stepping produces; a caller that cares should
+   check, by comparing the state a period later. */
+unsigned long osc_graph_period(oscgraph_t *graph, unsigned long limit)
+{
+  osc_t *osc;
+  unsigned long period = 1, count, div;
+
+  for (osc = graph->root; osc; osc = osc->next) {
+    switch (osc->type) {
+    case otyp_Bounce:
+    case otyp_Wrap: {
+      /* Over a distance of range (there and back, for a Bounce), by
+	 steps of speed: it comes back after range/gcd(range, speed)
+	 steps. */
+      int min, max, step;
+      unsigned long long range, speed;
+      if (osc->type == otyp_Bounce) {
+	min = osc->u.obounce.min;
+	max = osc->u.obounce.max;
+	step = osc->u.obounce.step;
+      }
+      else {
+	min = osc->u.owrap.min;
+	max = osc->u.owrap.max;
+	step = osc->u.owrap.step;
+      }
+      if (step == 0 || max <= min)
+	continue;
+      range = (unsigned long long)((long long)max - min);
+      speed = (step < 0) ? -(long long)step : step;
+      if (speed > range)
+	return 0;
+      if (osc->type == otyp_Bounce)
+	range *= 2;
+      if (range > limit * (unsigned long long)speed)
+	return 0;
+      count = (unsigned long)(range / gcd(range, speed));
+      break;
+    }
+    case otyp_Phaser:
+      if (osc->u.ophaser.phaselen <= 0)
+	return 0;
+      if ((unsigned long)osc->u.ophaser.phaselen > limit / NUM_PHASES)
+	return 0;
+      count = (unsigned long)osc->u.ophaser.phaselen * NUM_PHASES;
+      break;
+    case otyp_RandPhaser:
+    case otyp_VeloWrap:
+      return 0;
+    default:
+      continue;
+    }
+
+    div = (unsigned long)gcd(period, count);
+    if (period / div > limit / count)
+      return 0;
+    period = (period / div) * count;
+  }
+
+  return period;
+}
+
+static unsigned long long gcd(unsigned long long a, unsigned long long b)
+{
+  while (b) {
+    unsigned long long t = a % b;
+    a = b;
+    b = t;
   }
+  return a;
 }
 
-/* Return a random number between min and max, inclusive. */
-static int rand_range(int min, int max)
+/* Return a random number between min and max, inclusive, from the graph's
+   own stream. */
+static int rand_range(oscgraph_t *graph, int min, int max)
 {
   int res;
   unsigned int diff = (max+1) - min;
   if (diff <= 1)
     return min;
-  res = rand() % diff;
+  res = rand_r(&graph->seed) % diff;
   return min+res;
 }
 
+/* Work out the least and greatest values that osc_get(osc, 0) can ever
+   return. (Buffer only asks for element 0, so that's all we need.) */
+static void osc_range(osc_t *osc, int *min, int *max)
+{
+  int ix, lo, hi;
+
+  if (!osc) {
+    *min = *max = 0;
+    return;
+  }
+
+  switch (osc->type) {
+
+  case otyp_Constant:
+    *min = *max = osc->u.oconstant.val;
+    break;
+
+  case otyp_Bounce:
+    *min = osc->u.obounce.min;
+    *max = osc->u.obounce.max;
+    break;
+
+  case otyp_Wrap:
+    *min = osc->u.owrap.min;
+    *max = osc->u.owrap.max;
+    break;
+
+  case otyp_VeloWrap:
+    *min = osc->u.ovelowrap.min;
+    *max = osc->u.ovelowrap.max;
+    break;
+
+  case otyp_Phaser:
+  case otyp_RandPhaser:
+    *min = 0;
+    *max = NUM_PHASES-1;
+    break;
+
+  case otyp_Linear:
+    /* At element 0, this is just the base. */
+    osc_range(osc->u.olinear.base, min, max);
+    break;
+
+  case otyp_Multiplex:
+    osc_range(osc->u.omultiplex.val[0], min, max);
+    for (ix=1; ix<NUM_PHASES; ix++) {
+      osc_range(osc->u.omultiplex.val[ix], &lo, &hi);
+      if (lo < *min)
+	*min = lo;
+      if (hi > *max)
+	*max = hi;
+    }
+    break;
+
+  case otyp_Buffer:
+    osc_range(osc->u.obuffer.val, min, max);
+    break;
+
+  default:
+    *min = *max = 0;
+    break;
+  }
+}
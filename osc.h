@@ -16,7 +16,7 @@
    To simplify the code, we don't try to calculate f(i) for any
    arbitrary i. Instead, we start with i=0. Calling osc_get(f)
    returns f(0) for all osc_t's in the system. When we're ready, we
-   call osc_increment(), which advances every osc_t to i=1;
+   call osc_increment(), which advances every osc_t (in the graph) to i=1;
    thereafter, calling osc_get(f) returns f(1). When you call
    osc_increment() again, you get f(2). And so on. You can't go
    backwards, or move forwards more than 1 at a time, or move some
@@ -85,6 +85,19 @@
      exercise.
 */
 
+/* If OSC_COMPACT is defined, Buffer keeps its ring of old values in 16
+   bits, which halves the memory that dominates a big graph. Every value
+   that goes into a Buffer must then fit in a range of 65535; the ranges
+   are worked out when the Buffer is created, and a graph which breaks
+   the rule is a fatal error. (All the graphs in move.c fit easily.)
+
+   That's all it does: it saves memory, not time. Everything else,
+   osc_get_block() included, still works in ints, since what reads the
+   values (compute_elist() in move.c) does its sums in int and float
+   anyway; a 16-bit block would only be widened again at once. A Buffer's
+   block is widened as it's copied out, which is a little slower than
+   the plain memcpy. */
+
 #define otyp_Constant (1)
 #define otyp_Bounce (2)
 #define otyp_Wrap (3)
@@ -101,6 +114,13 @@ typedef struct osc_struct {
     
   struct osc_struct *next; /* osc.c uses this to maintain a private linked list
 			      of all osc_t objects created. */
+
+  /* How osc_increment() keeps this node up to date; see osc.c. */
+  struct oscgraph_struct *graph; /* The graph this belongs to. */
+  unsigned long stamp; /* The graph tick this node's state is current for. */
+  struct osc_struct *nextstep; /* The next node stepped on every tick. */
+  struct osc_struct *owner; /* The Buffer that steps this node, if any. */
+  int readers; /* How many nodes read this one. */
     
   /* Union of the data used by all the possible osc_t functions. */
   union {
@@ -142,11 +162,38 @@ typedef struct osc_struct {
     struct obuffer_struct {
       struct osc_struct *val;
       int firstel;
-      int el[NUM_ELS];
+      /* The ring is stored twice over, el[ix] and el[ix+NUM_ELS], so the
+	 current N-tuple is always el[firstel] to el[firstel+NUM_ELS-1]
+	 with no wrapping. */
+#ifdef OSC_COMPACT
+      int bias; /* The least value that val can produce. */
+      unsigned short el[2*NUM_ELS]; /* Stored as offsets from bias. */
+#else
+      int el[2*NUM_ELS];
+#endif
     } obuffer;
   } u;
 } osc_t;
 
+/* A graph is a set of osc_t objects which are incremented together, and
+   the random number stream that they draw from. Separate graphs don't
+   affect each other at all, so they can be incremented on different
+   threads. (The new_osc_* functions all add to the graph that this thread
+   last passed to osc_set_graph(), so they can be built on different
+   threads too.) */
+typedef struct oscgraph_struct {
+  osc_t *root; /* The linked list of osc_t objects, in creation order. */
+  osc_t **tail;
+  unsigned int seed;
+  unsigned long tick; /* How many times osc_increment() has been called. */
+  osc_t *steps; /* The nodes it steps every time, in creation order. */
+  int planned; /* Whether steps has been worked out yet. */
+} oscgraph_t;
+
+extern void osc_init_graph(oscgraph_t *graph, unsigned int seed);
+extern void osc_set_graph(oscgraph_t *graph);
+extern void osc_free_graph(oscgraph_t *graph);
+
 extern osc_t *new_osc_constant(int val);
 extern osc_t *new_osc_bounce(int min, int max, int step);
 extern osc_t *new_osc_wrap(int min, int max, int step);
@@ -159,5 +206,9 @@ extern osc_t *new_osc_multiplex(osc_t *sel, osc_t *ox0, osc_t *ox1,
   osc_t *ox2, osc_t *ox3);
 
 extern int osc_get(osc_t *osc, int el);
-extern void osc_increment(void);
+extern void osc_get_block(osc_t *osc, int *vals);
+extern void osc_increment(oscgraph_t *graph);
+extern void osc_save(oscgraph_t *graph, FILE *fl);
+extern int osc_load(oscgraph_t *graph, FILE *fl);
+extern unsigned long osc_graph_period(oscgraph_t *graph, unsigned long limit);
 
@@ -0,0 +1,273 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+/* The packed renderer (--packed). An elem_t is 36 bytes of floats, but
+   very little of that is news: every position lies within the unit
+   cylinder, every color is a fully opaque RGB, and vervec is the same
+   for every polygon. So each polygon goes to the card as a 10-byte
+   record -- three normalized shorts and three normalized bytes -- and a
+   small vertex shader turns each record into a square, one instance per
+   polygon. The transformation and lighting are the same sums that
+   view_transform() gives soft.c. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "general.h"
+#include "osc.h"
+#include "move.h"
+#include "view.h"
+#include "packed.h"
+#include "gpuprof.h"
+
+typedef struct packedel_struct {
+  GLshort pos[3]; /* -32767 to 32767 for -1.0 to 1.0 */
+  GLubyte col[3];
+  GLubyte pad;
+} packedel_t;
+
+static packedel_t records[NUM_ELS];
+
+static GLuint program = 0;
+static GLuint corner_buf = 0, record_buf = 0;
+static GLint loc_corner, loc_pos, loc_col;
+static GLint loc_mvp, loc_vervec, loc_light, loc_flatcol;
+/* Before GL 3.3, instancing comes from the ARB extensions, whose entry
+   points have their own names. */
+static int arb_instancing = FALSE;
+
+/* Each corner of the square is a multiple of vervec plus a multiple of
+   vervec turned 90 degrees, in the order win_draw() uses. */
+static GLfloat corners[4][2] = {
+  { -1.0, 0.0 }, { 0.0, -1.0 }, { 1.0, 0.0 }, { 0.0, 1.0 }
+};
+
+static char *vertex_source =
+  "#version 120\n"
+  "attribute vec2 corner;\n"
+  "attribute vec3 pos;\n"
+  "attribute vec3 col;\n"
+  "uniform mat4 mvp;\n"
+  "uniform vec2 vervec;\n"
+  "uniform float light;\n"
+  "uniform vec4 flatcol;\n"
+  "void main() {\n"
+  "  vec2 off = corner.x * vervec + corner.y * vec2(-vervec.y, vervec.x);\n"
+  "  gl_Position = mvp * vec4(pos.xy + off, pos.z, 1.0);\n"
+  "  gl_FrontColor = vec4(min(mix(col, flatcol.rgb, flatcol.a) * light,\n"
+  "    1.0), 1.0);\n"
+  "}\n";
+
+static char *fragment_source =
+  "#version 120\n"
+  "void main() {\n"
+  "  gl_FragColor = gl_Color;\n"
+  "}\n";
+
+static GLuint compile_shader(GLenum type, char *source);
+static void set_divisor(GLint loc, GLuint divisor);
+static void draw_instanced(GLenum mode, GLsizei count);
+
+/* Set up the shader and buffers in the current context. Returns FALSE if
+   the GL can't do instancing, in which case the caller should fall back
+   to the usual drawing. */
+int packed_init()
+{
+  const char *version = (const char *)glGetString(GL_VERSION);
+  int major = 0, minor = 0;
+  GLuint vs, fs;
+  GLint status;
+
+  if (version)
+    sscanf(version, "%d.%d", &major, &minor);
+  if (major*10 + minor < 33 &&
+    !(gl_has_extension("GL_ARB_instanced_arrays") &&
+      gl_has_extension("GL_ARB_draw_instanced") && major >= 2))
+    return FALSE;
+  arb_instancing = (major*10 + minor < 33);
+
+  vs = compile_shader(GL_VERTEX_SHADER, vertex_source);
+  fs = compile_shader(GL_FRAGMENT_SHADER, fragment_source);
+  if (!vs || !fs)
+    return FALSE;
+
+  program = glCreateProgram();
+  glAttachShader(program, vs);
+  glAttachShader(program, fs);
+  glLinkProgram(program);
+  glDeleteShader(vs);
+  glDeleteShader(fs);
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (!status) {
+    fprintf(stderr, "%s: couldn't link the packed shader\n", progname);
+    glDeleteProgram(program);
+    program = 0;
+    return FALSE;
+  }
+
+  loc_corner = glGetAttribLocation(program, "corner");
+  loc_pos = glGetAttribLocation(program, "pos");
+  loc_col = glGetAttribLocation(program, "col");
+  loc_mvp = glGetUniformLocation(program, "mvp");
+  loc_vervec = glGetUniformLocation(program, "vervec");
+  loc_light = glGetUniformLocation(program, "light");
+  loc_flatcol = glGetUniformLocation(program, "flatcol");
+
+  glGenBuffers(1, &corner_buf);
+  glBindBuffer(GL_ARRAY_BUFFER, corner_buf);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+  glGenBuffers(1, &record_buf);
+  glBindBuffer(GL_ARRAY_BUFFER, record_buf);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(records), NULL, GL_STREAM_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  return TRUE;
+}
+
+static GLuint compile_shader(GLenum type, char *source)
+{
+  GLuint shader = glCreateShader(type);
+  GLint status;
+
+  glShaderSource(shader, 1, (const GLchar **)&source, NULL);
+  glCompileShader(shader);
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if (!status) {
+    char log[512];
+    glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+    fprintf(stderr, "%s: couldn't compile the packed shader: %s\n",
+      progname, log);
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+static void set_divisor(GLint loc, GLuint divisor)
+{
+  if (arb_instancing)
+    glVertexAttribDivisorARB(loc, divisor);
+  else
+    glVertexAttribDivisor(loc, divisor);
+}
+
+/* Draw count instances of the four corners. */
+static void draw_instanced(GLenum mode, GLsizei count)
+{
+  if (arb_instancing)
+    glDrawArraysInstancedARB(mode, 0, 4, count);
+  else
+    glDrawArraysInstanced(mode, 0, 4, count);
+}
+
+static GLshort pack_coord(GLfloat val)
+{
+  if (val >= 1.0)
+    return 32767;
+  if (val <= -1.0)
+    return -32767;
+  return (GLshort)(val * 32767.0 + (val >= 0.0 ? 0.5 : -0.5));
+}
+
+static GLubyte pack_channel(GLfloat val)
+{
+  if (val >= 1.0)
+    return 255;
+  if (val <= 0.0)
+    return 0;
+  return (GLubyte)(val * 255.0 + 0.5);
+}
+
+/* Clear the buffers and draw a list of polygons, the same way that
+   view_draw_scene() does. */
+void packed_draw(elem_t *list, int stride, int edges, int wire)
+{
+  static GLfloat white[] = { 1.0, 1.0, 1.0, 1.0 };
+  static GLfloat grey[] =  { 0.6, 0.6, 0.6, 1.0 };
+  GLfloat mvp[16];
+  GLfloat light;
+  int ix, jx, last, count, order;
+
+  view_transform(mvp, &light);
+
+  /* Drawing back to front without the depth test works one whole pass at
+     a time, so it can't put each square's edges over its own face and
+     under the next one. Faces alone, or edges alone, are fine. */
+  order = ((edges && !wire) ? 0 : view_painter_order(list, stride));
+  if (order) {
+    glDisable(GL_DEPTH_TEST);
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
+  else {
+    glEnable(GL_DEPTH_TEST);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  }
+
+  /* Instances are drawn in the order of their records. */
+  count = 0;
+  last = ((NUM_ELS - 1) / stride) * stride;
+  for (ix=0; ix<=last; ix+=stride) {
+    elem_t *el = &list[(order < 0) ? last - ix : ix];
+    packedel_t *rec = &records[count++];
+    for (jx=0; jx<3; jx++) {
+      rec->pos[jx] = pack_coord(el->pos[jx]);
+      rec->col[jx] = pack_channel(el->col[jx]);
+    }
+    rec->pad = 0;
+  }
+
+  glUseProgram(program);
+  glUniformMatrix4fv(loc_mvp, 1, GL_FALSE, mvp);
+  glUniform2f(loc_vervec, list[0].vervec[0], list[0].vervec[1]);
+  glUniform1f(loc_light, light);
+
+  glBindBuffer(GL_ARRAY_BUFFER, record_buf);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(records), NULL, GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(packedel_t), records);
+  glVertexAttribPointer(loc_pos, 3, GL_SHORT, GL_TRUE, sizeof(packedel_t),
+    (void *)0);
+  glVertexAttribPointer(loc_col, 3, GL_UNSIGNED_BYTE, GL_TRUE,
+    sizeof(packedel_t), (void *)offsetof(packedel_t, col));
+  set_divisor(loc_pos, 1);
+  set_divisor(loc_col, 1);
+  glEnableVertexAttribArray(loc_pos);
+  glEnableVertexAttribArray(loc_col);
+
+  glBindBuffer(GL_ARRAY_BUFFER, corner_buf);
+  glVertexAttribPointer(loc_corner, 2, GL_FLOAT, GL_FALSE, 0, (void *)0);
+  glEnableVertexAttribArray(loc_corner);
+
+  /* Edges first, so that they win the depth test against their own
+     faces. */
+  if (edges || wire) {
+    GLfloat *col = (wire ? white : grey);
+    glUniform4f(loc_flatcol, col[0], col[1], col[2], 1.0);
+    gpuprof_begin(GPU_EDGES);
+    draw_instanced(GL_LINE_LOOP, count);
+    gpuprof_end(GPU_EDGES);
+  }
+  if (!wire) {
+    glUniform4f(loc_flatcol, 0.0, 0.0, 0.0, 0.0);
+    gpuprof_begin(GPU_FACES);
+    draw_instanced(GL_TRIANGLE_FAN, count);
+    gpuprof_end(GPU_FACES);
+  }
+
+  glDisableVertexAttribArray(loc_corner);
+  glDisableVertexAttribArray(loc_pos);
+  glDisableVertexAttribArray(loc_col);
+  set_divisor(loc_pos, 0);
+  set_divisor(loc_col, 0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glUseProgram(0);
+}
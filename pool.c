@@ -0,0 +1,133 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+/* A very small thread pool. There's only one thing it knows how to do:
+   pool_run(count, func, rock) calls func(ix, rock) for every ix from 0 to
+   count-1, spread across all the threads, and returns when they're all
+   done. The calling thread pitches in too, so a pool of one thread is
+   just a loop. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "general.h"
+#include "pool.h"
+
+/* How many threads to use, counting the caller. Zero means one per
+   processor. */
+int pool_threads = 0;
+
+static pthread_t *workers = NULL;
+static int numworkers = 0;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+
+/* The job in progress. generation goes up by one for each pool_run(), so
+   that a worker can tell a new job from the one it just finished. */
+static long generation = 0;
+static void (*job_func)(int ix, void *rock) = NULL;
+static void *job_rock = NULL;
+static int job_count = 0;
+static int job_next = 0; /* next ix to hand out */
+static int job_busy = 0; /* workers still working on this job */
+
+static void *worker_thread(void *rock);
+static void do_work(void);
+
+int init_pool()
+{
+  int ix;
+
+  if (workers)
+    return TRUE;
+
+  if (pool_threads <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    pool_threads = (cpus > 0) ? (int)cpus : 1;
+  }
+
+  numworkers = pool_threads - 1;
+  if (numworkers <= 0)
+    return TRUE;
+
+  workers = (pthread_t *)malloc(numworkers * sizeof(pthread_t));
+  if (!workers)
+    return FALSE;
+  for (ix=0; ix<numworkers; ix++) {
+    if (pthread_create(&workers[ix], NULL, worker_thread, NULL)) {
+      numworkers = ix;
+      break;
+    }
+  }
+
+  return TRUE;
+}
+
+void pool_run(int count, void (*func)(int ix, void *rock), void *rock)
+{
+  if (numworkers <= 0 || count <= 1) {
+    int ix;
+    for (ix=0; ix<count; ix++)
+      func(ix, rock);
+    return;
+  }
+
+  pthread_mutex_lock(&pool_lock);
+  job_func = func;
+  job_rock = rock;
+  job_count = count;
+  job_next = 0;
+  job_busy = numworkers;
+  generation++;
+  pthread_cond_broadcast(&pool_start);
+  pthread_mutex_unlock(&pool_lock);
+
+  do_work();
+
+  pthread_mutex_lock(&pool_lock);
+  while (job_busy > 0)
+    pthread_cond_wait(&pool_done, &pool_lock);
+  pthread_mutex_unlock(&pool_lock);
+}
+
+/* Take items off the current job until there are none left. */
+static void do_work()
+{
+  while (1) {
+    int ix = __atomic_fetch_add(&job_next, 1, __ATOMIC_RELAXED);
+    if (ix >= job_count)
+      break;
+    job_func(ix, job_rock);
+  }
+}
+
+static void *worker_thread(void *rock)
+{
+  long seen = 0;
+
+  while (1) {
+    pthread_mutex_lock(&pool_lock);
+    while (generation == seen)
+      pthread_cond_wait(&pool_start, &pool_lock);
+    seen = generation;
+    pthread_mutex_unlock(&pool_lock);
+
+    do_work();
+
+    pthread_mutex_lock(&pool_lock);
+    job_busy--;
+    if (job_busy == 0)
+      pthread_cond_signal(&pool_done);
+    pthread_mutex_unlock(&pool_lock);
+  }
+
+  return NULL;
+}
@@ -0,0 +1,133 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+/* Publishing the list of polygons in shared memory, so that other
+   programs can follow along. (A sound generator, say -- StonerSound
+   rides again.) The layout is described in stonerpub.h. We write and
+   never wait; a reader that can't keep up just misses frames. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <GL/gl.h>
+
+#include "general.h"
+#include "osc.h"
+#include "move.h"
+#include "view.h"
+#include "stonerpub.h"
+#include "publish.h"
+
+/* The name of the shared-memory segment, from --publish. NULL if we're
+   not publishing. */
+char *publish_name = NULL;
+
+static char shmname[256];
+static void *shmbase = NULL;
+static size_t shmsize = 0;
+static stonerpub_header_t *header = NULL;
+static uint64_t framecount = 0;
+
+static void final_publish(void);
+
+int init_publish()
+{
+  int fd;
+
+  if (!publish_name)
+    return TRUE;
+
+  /* The wire format had better match elem_t, since we copy it across
+     wholesale. */
+  if (sizeof(stonerpub_elem_t) != sizeof(elem_t)) {
+    fprintf(stderr, "%s: elem_t doesn't match the published layout\n",
+      progname);
+    return FALSE;
+  }
+
+  if (publish_name[0] == '/')
+    snprintf(shmname, sizeof(shmname), "%s", publish_name);
+  else
+    snprintf(shmname, sizeof(shmname), "/%s", publish_name);
+
+  shmsize = sizeof(stonerpub_header_t)
+    + STONERPUB_SLOTS * STONERPUB_SLOTSIZE(NUM_ELS);
+
+  fd = shm_open(shmname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "%s: ", progname);
+    perror(shmname);
+    return FALSE;
+  }
+  if (ftruncate(fd, shmsize) < 0) {
+    fprintf(stderr, "%s: ", progname);
+    perror(shmname);
+    close(fd);
+    shm_unlink(shmname);
+    return FALSE;
+  }
+  shmbase = mmap(NULL, shmsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shmbase == MAP_FAILED) {
+    fprintf(stderr, "%s: ", progname);
+    perror(shmname);
+    shmbase = NULL;
+    shm_unlink(shmname);
+    return FALSE;
+  }
+
+  /* ftruncate() gave us zeroes, so every slot starts out with an even
+     sequence number and frame 0, and latest says there's nothing yet. */
+  header = (stonerpub_header_t *)shmbase;
+  header->numels = NUM_ELS;
+  header->numslots = STONERPUB_SLOTS;
+  header->slotsize = STONERPUB_SLOTSIZE(NUM_ELS);
+  header->version = STONERPUB_VERSION;
+  __atomic_store_n(&header->magic, STONERPUB_MAGIC, __ATOMIC_RELEASE);
+
+  atexit(final_publish);
+  return TRUE;
+}
+
+static void final_publish()
+{
+  if (!shmbase)
+    return;
+  munmap(shmbase, shmsize);
+  shmbase = NULL;
+  shm_unlink(shmname);
+}
+
+/* Copy the current elist into the next slot of the ring. */
+void publish_frame()
+{
+  stonerpub_slot_t *slot;
+  uint32_t seq;
+
+  if (!shmbase)
+    return;
+
+  framecount++;
+  slot = (stonerpub_slot_t *)((char *)shmbase + sizeof(stonerpub_header_t)
+    + (framecount % STONERPUB_SLOTS) * header->slotsize);
+
+  /* Mark the slot as in progress, fill it in, and mark it done. The
+     fences keep the copy from drifting outside the two marks. */
+  seq = slot->seq;
+  __atomic_store_n(&slot->seq, seq+1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  slot->frame = framecount;
+  memcpy(slot->el, elist, sizeof(elem_t) * NUM_ELS);
+
+  __atomic_store_n(&slot->seq, seq+2, __ATOMIC_RELEASE);
+  __atomic_store_n(&header->latest, framecount, __ATOMIC_RELEASE);
+}
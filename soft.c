@@ -0,0 +1,387 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+/* A software renderer, for machines with no usable GL at all. What we
+   draw is simple enough -- a few flat-shaded squares with a depth test,
+   and maybe some lines around them -- that we can do the whole job
+   ourselves.
+
+   The screen is cut into square tiles. First we transform every polygon
+   and note which tiles it touches ("binning"). Then the tiles are drawn
+   independently, in parallel, each with its own patch of the color and
+   depth buffers. Within a tile, polygons are drawn in list order, so the
+   result is the same as drawing them one after another.
+
+   The output is 32-bit pixels, B G R A in memory, rows top to bottom.
+   The same layout that an X server wants for a 24-bit TrueColor
+   display, as it happens. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <GL/gl.h>
+
+#include "general.h"
+#include "osc.h"
+#include "move.h"
+#include "view.h"
+#include "pool.h"
+#include "soft.h"
+
+#define TILE (64) /* pixels on a side; must be a multiple of 4 */
+
+/* Four floats or ints at a time, via GCC's vector extension. */
+typedef float v4f __attribute__ ((vector_size (16)));
+typedef int32_t v4i __attribute__ ((vector_size (16)));
+
+typedef struct svert_struct {
+  float x, y, z; /* window coordinates, y down, z from 0 to 1 */
+} svert_t;
+
+static int width = 0, height = 0;
+static unsigned char *color = NULL;
+static int color_stride = 0;
+static int own_color = FALSE;
+static float *depth = NULL;
+static int depth_stride = 0; /* in floats; a multiple of TILE */
+
+static int tiles_x = 0, tiles_y = 0;
+static short *bins = NULL; /* NUM_ELS entries for each tile */
+static int *bincount = NULL;
+
+/* The current frame, after transformation. */
+static svert_t verts[NUM_ELS][4];
+static uint32_t facecol[NUM_ELS];
+static char front[NUM_ELS];
+static uint32_t edgecol;
+static int draw_edges, draw_faces;
+
+static void raster_tile(int tile, void *rock);
+static void raster_tri(int x0, int y0, int x1, int y1,
+  svert_t *v0, svert_t *v1, svert_t *v2, uint32_t col);
+static void raster_line(int x0, int y0, int x1, int y1,
+  svert_t *v0, svert_t *v1, uint32_t col);
+static uint32_t pack_color(GLfloat *col, GLfloat light);
+
+/* Set the size of the output. If pixels is NULL, we allocate the color
+   buffer ourselves; otherwise we draw straight into the given buffer (an
+   XImage, for example), whose rows are stride bytes apart. */
+int soft_resize(int newwidth, int newheight, unsigned char *pixels,
+  int stride)
+{
+  if (own_color)
+    free(color);
+  free(depth);
+  free(bins);
+  free(bincount);
+
+  width = newwidth;
+  height = newheight;
+  tiles_x = (width + TILE-1) / TILE;
+  tiles_y = (height + TILE-1) / TILE;
+
+  if (pixels) {
+    color = pixels;
+    color_stride = stride;
+    own_color = FALSE;
+  }
+  else {
+    color_stride = width * 4;
+    color = (unsigned char *)malloc((size_t)color_stride * height);
+    own_color = TRUE;
+  }
+
+  depth_stride = tiles_x * TILE;
+  depth = (float *)malloc((size_t)depth_stride * tiles_y * TILE
+    * sizeof(float));
+  bins = (short *)malloc((size_t)tiles_x * tiles_y * NUM_ELS
+    * sizeof(short));
+  bincount = (int *)malloc((size_t)tiles_x * tiles_y * sizeof(int));
+
+  if (!color || !depth || !bins || !bincount) {
+    fprintf(stderr, "%s: out of memory\n", progname);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+unsigned char *soft_pixels(int *stride)
+{
+  *stride = color_stride;
+  return color;
+}
+
+/* Draw a list of polygons, the same way that win_draw() does with GL. */
+void soft_draw(elem_t *list, int stride, int edges, int wire)
+{
+  static GLfloat white[] = { 1.0, 1.0, 1.0, 1.0 };
+  static GLfloat grey[] =  { 0.6, 0.6, 0.6, 1.0 };
+  GLfloat mvp[16];
+  GLfloat light;
+  int ix, jx, tx, ty;
+
+  view_transform(mvp, &light);
+
+  draw_edges = (edges || wire);
+  draw_faces = !wire;
+  edgecol = pack_color(wire ? white : grey, light);
+
+  memset(bincount, 0, (size_t)tiles_x * tiles_y * sizeof(int));
+
+  for (ix=0; ix<NUM_ELS; ix+=stride) {
+    elem_t *el = &list[ix];
+    svert_t *sv = verts[ix];
+    GLfloat corner[4][2];
+    float minx, maxx, miny, maxy, area;
+    int ok = TRUE;
+
+    corner[0][0] = el->pos[0] - el->vervec[0];
+    corner[0][1] = el->pos[1] - el->vervec[1];
+    corner[1][0] = el->pos[0] + el->vervec[1];
+    corner[1][1] = el->pos[1] - el->vervec[0];
+    corner[2][0] = el->pos[0] + el->vervec[0];
+    corner[2][1] = el->pos[1] + el->vervec[1];
+    corner[3][0] = el->pos[0] - el->vervec[1];
+    corner[3][1] = el->pos[1] + el->vervec[0];
+
+    for (jx=0; jx<4; jx++) {
+      GLfloat x = corner[jx][0], y = corner[jx][1], z = el->pos[2];
+      GLfloat cx = mvp[0]*x + mvp[4]*y + mvp[8]*z + mvp[12];
+      GLfloat cy = mvp[1]*x + mvp[5]*y + mvp[9]*z + mvp[13];
+      GLfloat cz = mvp[2]*x + mvp[6]*y + mvp[10]*z + mvp[14];
+      GLfloat cw = mvp[3]*x + mvp[7]*y + mvp[11]*z + mvp[15];
+      /* Nothing in this scene comes near the eye, so rather than clip
+	 against the near plane, we just drop anything that crosses it. */
+      if (cw < 0.001) {
+	ok = FALSE;
+	break;
+      }
+      sv[jx].x = (cx / cw + 1.0) * 0.5 * width;
+      sv[jx].y = (1.0 - cy / cw) * 0.5 * height;
+      sv[jx].z = (cz / cw) * 0.5 + 0.5;
+    }
+    if (!ok)
+      continue;
+
+    /* GL calls a polygon front-facing if it's counterclockwise with y
+       up. We have y down, so it's the other way around. */
+    area = 0.0;
+    for (jx=0; jx<4; jx++) {
+      svert_t *a = &sv[jx];
+      svert_t *b = &sv[(jx+1) % 4];
+      area += a->x * b->y - b->x * a->y;
+    }
+    front[ix] = (area < 0.0);
+    if (!draw_edges && !front[ix])
+      continue;
+
+    facecol[ix] = pack_color(el->col, light);
+
+    minx = maxx = sv[0].x;
+    miny = maxy = sv[0].y;
+    for (jx=1; jx<4; jx++) {
+      if (sv[jx].x < minx) minx = sv[jx].x;
+      if (sv[jx].x > maxx) maxx = sv[jx].x;
+      if (sv[jx].y < miny) miny = sv[jx].y;
+      if (sv[jx].y > maxy) maxy = sv[jx].y;
+    }
+    if (maxx < 0 || maxy < 0 || minx >= width || miny >= height)
+      continue;
+    if (minx < 0) minx = 0;
+    if (miny < 0) miny = 0;
+    if (maxx > width-1) maxx = width-1;
+    if (maxy > height-1) maxy = height-1;
+
+    for (ty = (int)miny / TILE; ty <= (int)maxy / TILE; ty++) {
+      for (tx = (int)minx / TILE; tx <= (int)maxx / TILE; tx++) {
+	int tile = ty * tiles_x + tx;
+	bins[tile * NUM_ELS + bincount[tile]++] = ix;
+      }
+    }
+  }
+
+  pool_run(tiles_x * tiles_y, raster_tile, NULL);
+}
+
+/* GL clamps lit colors to 1.0; so do we. */
+static uint32_t pack_color(GLfloat *col, GLfloat light)
+{
+  int jx;
+  uint32_t val[3];
+
+  for (jx=0; jx<3; jx++) {
+    GLfloat f = col[jx] * light;
+    if (f > 1.0) f = 1.0;
+    if (f < 0.0) f = 0.0;
+    val[jx] = (uint32_t)(f * 255.0 + 0.5);
+  }
+  return (0xFF000000 | (val[0] << 16) | (val[1] << 8) | val[2]);
+}
+
+static void raster_tile(int tile, void *rock)
+{
+  int tx = tile % tiles_x;
+  int ty = tile / tiles_x;
+  int x0 = tx * TILE, y0 = ty * TILE;
+  int x1 = x0 + TILE, y1 = y0 + TILE;
+  int y, ix;
+
+  if (x1 > width) x1 = width;
+  if (y1 > height) y1 = height;
+
+  /* Clear our patch. The depth buffer is cleared over the whole tile,
+     padding and all, since the SIMD loops can touch it. */
+  for (y=y0; y<y1; y++) {
+    memset(color + (size_t)y * color_stride + x0*4, 0, (x1-x0) * 4);
+  }
+  for (y=y0; y<y0+TILE; y++) {
+    float *row = depth + (size_t)y * depth_stride + x0;
+    for (ix=0; ix<TILE; ix++)
+      row[ix] = 1.0;
+  }
+
+  for (ix=0; ix<bincount[tile]; ix++) {
+    int el = bins[tile * NUM_ELS + ix];
+    svert_t *sv = verts[el];
+
+    if (draw_edges) {
+      raster_line(x0, y0, x1, y1, &sv[0], &sv[1], edgecol);
+      raster_line(x0, y0, x1, y1, &sv[1], &sv[2], edgecol);
+      raster_line(x0, y0, x1, y1, &sv[2], &sv[3], edgecol);
+      raster_line(x0, y0, x1, y1, &sv[3], &sv[0], edgecol);
+    }
+    if (draw_faces && front[el]) {
+      raster_tri(x0, y0, x1, y1, &sv[0], &sv[1], &sv[2], facecol[el]);
+      raster_tri(x0, y0, x1, y1, &sv[0], &sv[2], &sv[3], facecol[el]);
+    }
+  }
+}
+
+/* Draw one triangle, clipped to the tile (x0,y0)-(x1,y1). A pixel is
+   inside if its center is on the inner side of all three edges. We
+   evaluate the edge functions four pixels at a time. */
+static void raster_tri(int x0, int y0, int x1, int y1,
+  svert_t *v0, svert_t *v1, svert_t *v2, uint32_t col)
+{
+  float a0, b0, c0, a1, b1, c1, a2, b2, c2;
+  float za, zb, zc;
+  float area, minx, maxx, miny, maxy;
+  int bx0, by0, bx1, by1, x, y;
+  v4f lanes = { 0.5, 1.5, 2.5, 3.5 };
+
+  area = (v1->x - v0->x) * (v2->y - v0->y)
+    - (v1->y - v0->y) * (v2->x - v0->x);
+  if (area == 0.0)
+    return;
+  if (area < 0.0) {
+    /* Turn it around, so that "inside" is positive for every edge. */
+    svert_t *tmp = v1;
+    v1 = v2;
+    v2 = tmp;
+    area = -area;
+  }
+
+  /* Edge function for the edge from p to q: a*x + b*y + c. Each one is
+     positive on the side facing the third vertex. */
+#define EDGE(p, q, a, b, c) \
+  a = (p)->y - (q)->y; \
+  b = (q)->x - (p)->x; \
+  c = -(a * (p)->x + b * (p)->y);
+  EDGE(v1, v2, a0, b0, c0);
+  EDGE(v2, v0, a1, b1, c1);
+  EDGE(v0, v1, a2, b2, c2);
+#undef EDGE
+
+  /* Depth is linear in screen space: z = za*x + zb*y + zc. */
+  za = (a0 * v0->z + a1 * v1->z + a2 * v2->z) / area;
+  zb = (b0 * v0->z + b1 * v1->z + b2 * v2->z) / area;
+  zc = (c0 * v0->z + c1 * v1->z + c2 * v2->z) / area;
+
+  minx = maxx = v0->x;
+  miny = maxy = v0->y;
+  if (v1->x < minx) minx = v1->x;
+  if (v1->x > maxx) maxx = v1->x;
+  if (v2->x < minx) minx = v2->x;
+  if (v2->x > maxx) maxx = v2->x;
+  if (v1->y < miny) miny = v1->y;
+  if (v1->y > maxy) maxy = v1->y;
+  if (v2->y < miny) miny = v2->y;
+  if (v2->y > maxy) maxy = v2->y;
+
+  bx0 = (minx > x0) ? (int)minx : x0;
+  by0 = (miny > y0) ? (int)miny : y0;
+  bx1 = (maxx + 1 < x1) ? (int)maxx + 1 : x1;
+  by1 = (maxy + 1 < y1) ? (int)maxy + 1 : y1;
+  /* Line up on a group of four. x0 is a multiple of TILE, so this
+     doesn't leave the tile. */
+  bx0 &= ~3;
+
+  for (y=by0; y<by1; y++) {
+    float py = y + 0.5;
+    float *drow = depth + (size_t)y * depth_stride;
+    uint32_t *crow = (uint32_t *)(color + (size_t)y * color_stride);
+
+    for (x=bx0; x<bx1; x+=4) {
+      v4f px = lanes + (float)x;
+      v4f e0 = px * a0 + (b0 * py + c0);
+      v4f e1 = px * a1 + (b1 * py + c1);
+      v4f e2 = px * a2 + (b2 * py + c2);
+      v4f z = px * za + (zb * py + zc);
+      v4f dz;
+      v4i mask;
+      int lane;
+
+      memcpy(&dz, drow + x, sizeof(dz));
+      mask = (e0 >= 0) & (e1 >= 0) & (e2 >= 0) & (z < dz)
+	& (px < (float)bx1);
+      if (!(mask[0] | mask[1] | mask[2] | mask[3]))
+	continue;
+
+      dz = (v4f)(((v4i)z & mask) | ((v4i)dz & ~mask));
+      memcpy(drow + x, &dz, sizeof(dz));
+      for (lane=0; lane<4; lane++) {
+	if (mask[lane])
+	  crow[x+lane] = col;
+      }
+    }
+  }
+}
+
+/* Draw one line, clipped to the tile, by plain stepping along it a pixel
+   at a time. */
+static void raster_line(int x0, int y0, int x1, int y1,
+  svert_t *v0, svert_t *v1, uint32_t col)
+{
+  float dx = v1->x - v0->x;
+  float dy = v1->y - v0->y;
+  float dz = v1->z - v0->z;
+  float len = (fabs(dx) > fabs(dy)) ? fabs(dx) : fabs(dy);
+  int steps = (int)ceil(len);
+  int ix;
+
+  if (steps < 1)
+    steps = 1;
+
+  for (ix=0; ix<=steps; ix++) {
+    float frac = (float)ix / (float)steps;
+    int x = (int)floor(v0->x + dx * frac);
+    int y = (int)floor(v0->y + dy * frac);
+    float z = v0->z + dz * frac;
+    float *dp;
+
+    if (x < x0 || x >= x1 || y < y0 || y >= y1)
+      continue;
+    dp = depth + (size_t)y * depth_stride + x;
+    if (z < *dp) {
+      *dp = z;
+      ((uint32_t *)(color + (size_t)y * color_stride))[x] = col;
+    }
+  }
+}
@@ -0,0 +1,11 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+extern int soft_resize(int width, int height, unsigned char *pixels,
+  int stride);
+extern unsigned char *soft_pixels(int *stride);
+extern void soft_draw(elem_t *list, int stride, int edges, int wire);
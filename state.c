@@ -0,0 +1,131 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+/* Saving and restoring the simulation. A fresh graph takes a while to
+   get interesting -- every Buffer starts out full of one value -- so with
+   --load-state we pick up where a previous run (perhaps on another
+   machine) left off, and with --save-state we leave a file behind for
+   the next run. They can be the same file.
+
+   The file is a header, and then whatever move_save() writes. Every
+   number is a 32-bit little-endian signed integer, so a file is good on
+   any machine. The layout of the graph itself isn't saved, only its
+   state; move.c builds the graph as usual, and then checks that the file
+   matches it node for node. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <GL/gl.h>
+
+#include "general.h"
+#include "osc.h"
+#include "move.h"
+#include "view.h"
+#include "state.h"
+
+#define STATE_MAGIC (0x53565453) /* "STVS" */
+#define STATE_VERSION (3)
+
+char *state_save_file = NULL;
+char *state_load_file = NULL;
+
+static void final_state(void);
+
+/* Load the state file, if there is one, and arrange to save it when we
+   exit. A missing load file just means we start fresh; a file that
+   doesn't match this graph is an error. */
+int init_state()
+{
+  if (state_load_file) {
+    FILE *fl = fopen(state_load_file, "rb");
+    if (!fl) {
+      if (errno != ENOENT) {
+	perror(state_load_file);
+	return FALSE;
+      }
+    }
+    else {
+      int magic, version, numels, numphases;
+      int ok = (state_get(fl, &magic) && magic == STATE_MAGIC
+	&& state_get(fl, &version) && version == STATE_VERSION
+	&& state_get(fl, &numels) && numels == NUM_ELS
+	&& state_get(fl, &numphases) && numphases == NUM_PHASES
+	&& move_load(fl));
+      fclose(fl);
+      if (!ok) {
+	fprintf(stderr, "%s: %s is not a saved state for this graph\n",
+	  progname, state_load_file);
+	return FALSE;
+      }
+    }
+  }
+
+  if (state_save_file)
+    atexit(final_state);
+
+  return TRUE;
+}
+
+/* Write the state file. We write to a temporary file and rename it into
+   place, so that a crash never leaves half a state behind. */
+static void final_state()
+{
+  char *tmpname;
+  FILE *fl;
+  int ok;
+
+  tmpname = (char *)malloc(strlen(state_save_file) + 8);
+  if (!tmpname)
+    return;
+  sprintf(tmpname, "%s.tmp", state_save_file);
+
+  fl = fopen(tmpname, "wb");
+  if (!fl) {
+    perror(tmpname);
+    free(tmpname);
+    return;
+  }
+  state_put(fl, STATE_MAGIC);
+  state_put(fl, STATE_VERSION);
+  state_put(fl, NUM_ELS);
+  state_put(fl, NUM_PHASES);
+  move_save(fl);
+  ok = !ferror(fl);
+  if (fclose(fl) != 0)
+    ok = FALSE;
+
+  if (!ok || rename(tmpname, state_save_file) != 0) {
+    perror(state_save_file);
+    remove(tmpname);
+  }
+  free(tmpname);
+}
+
+void state_put(FILE *fl, int val)
+{
+  unsigned int uval = (unsigned int)val;
+  unsigned char buf[4];
+
+  buf[0] = uval & 0xFF;
+  buf[1] = (uval >> 8) & 0xFF;
+  buf[2] = (uval >> 16) & 0xFF;
+  buf[3] = (uval >> 24) & 0xFF;
+  fwrite(buf, 1, 4, fl);
+}
+
+int state_get(FILE *fl, int *val)
+{
+  unsigned char buf[4];
+
+  if (fread(buf, 1, 4, fl) != 4)
+    return FALSE;
+  *val = (int)((unsigned int)buf[0] | ((unsigned int)buf[1] << 8)
+    | ((unsigned int)buf[2] << 16) | ((unsigned int)buf[3] << 24));
+  return TRUE;
+}
@@ -0,0 +1,13 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+extern char *state_save_file;
+extern char *state_load_file;
+
+extern int init_state(void);
+extern void state_put(FILE *fl, int val);
+extern int state_get(FILE *fl, int *val);
@@ -0,0 +1,470 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+/* The simulation alone, with no display: a chain of every look, each
+   from the same fixed seed, run for a fixed number of steps. This is the
+   training workload for "make pgo", and a benchmark in its own right:
+
+     stonerbench [--steps N] [--seed N] [--engine tree|block]
+       [--trace FILE | --check FILE [--tolerance X]]
+       [--baseline FILE [--slack PERCENT] | --record FILE] [--runs N]
+       [--sums FILE | --record-sum FILE] [--resume STEP]
+
+   It prints the time taken and a checksum of the polygons, which should
+   be the same however the program was compiled.
+
+   The rest is for "make check-perf". --engine picks how the polygons
+   read the osc graph (see elist_blocks in move.c). --trace writes every
+   tenth step of every look to a file: the four integer parameters of
+   each polygon, then its floating-point position and color. --check
+   reads such a file back and compares, exactly for the integers and to
+   within the tolerance for the floats. --baseline looks up this engine's
+   time per step in a file of "ENGINE NANOSECONDS" lines, and fails if
+   it is more than the slack slower; --record appends such a line. The
+   engine is named "tree" or "block", with "-compact" on the end if this
+   was built with OSC_COMPACT. With --runs, the whole thing is run N
+   times and the fastest counts, which steadies the timing on a busy
+   machine.
+
+   A trace only shows that the engines agree with each other today; a
+   change to the stepping they share would move them all together. So
+   --sums looks up the checksum for this seed and step count in a file of
+   "SEED STEPS CHECKSUM" lines, kept with the source, and fails if it
+   differs; --record-sum appends such a line.
+
+   --resume checks --save-state and --load-state instead: each look is
+   saved at the given step, loaded into a chain built from another seed,
+   and both are run on to the end. Every step of the loaded one must be
+   the same, bit for bit, as the one that kept going. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <GL/gl.h>
+
+#include "general.h"
+#include "osc.h"
+#include "move.h"
+#include "timer.h"
+
+#define TRACE_EVERY (10)
+
+typedef struct tracerec_struct {
+  int vals[4][NUM_ELS]; /* theta, rad, alti, color */
+  GLfloat pos[NUM_ELS][3];
+  GLfloat col[NUM_ELS][4];
+} tracerec_t;
+
+char *progname = NULL;
+
+static chain_t chain;
+static elem_t list[NUM_ELS];
+
+static unsigned long checksum(unsigned long sum, elem_t *list);
+static void make_record(tracerec_t *rec);
+static int compare_record(tracerec_t *rec, tracerec_t *gold, double tol,
+  double *worst, int look, int step);
+static int check_baseline(char *filename, char *engine, double nsec,
+  double slack);
+static int check_sum(char *filename, unsigned int seed, int steps,
+  unsigned long sum);
+static int check_resume(unsigned int seed, int look, int resume,
+  int steps);
+
+int main(int argc, char *argv[])
+{
+  int steps = 20000;
+  unsigned int seed = 1;
+  int runs = 1;
+  int resume = -1;
+  int ix, run, look, step;
+  unsigned long sum = 0;
+  double start, secs = 0.0, nsec;
+  char engine[32];
+  char *tracename = NULL, *checkname = NULL;
+  char *basename = NULL, *recordname = NULL;
+  char *sumsname = NULL, *recordsumname = NULL;
+  double tolerance = 1.0e-5, slack = 20.0, worst = 0.0;
+  FILE *tracefl = NULL;
+  static tracerec_t rec, gold;
+
+  progname = argv[0];
+
+  for (ix=1; ix<argc; ix++) {
+    if (!strcmp(argv[ix], "--steps") && ix+1 < argc)
+      steps = atoi(argv[++ix]);
+    else if (!strcmp(argv[ix], "--seed") && ix+1 < argc)
+      seed = strtoul(argv[++ix], NULL, 10);
+    else if (!strcmp(argv[ix], "--engine") && ix+1 < argc) {
+      ix++;
+      if (!strcmp(argv[ix], "tree"))
+	elist_blocks = FALSE;
+      else if (!strcmp(argv[ix], "block"))
+	elist_blocks = TRUE;
+      else {
+	fprintf(stderr, "%s: --engine must be tree or block\n", progname);
+	return 1;
+      }
+    }
+    else if (!strcmp(argv[ix], "--trace") && ix+1 < argc)
+      tracename = argv[++ix];
+    else if (!strcmp(argv[ix], "--check") && ix+1 < argc)
+      checkname = argv[++ix];
+    else if (!strcmp(argv[ix], "--tolerance") && ix+1 < argc)
+      tolerance = atof(argv[++ix]);
+    else if (!strcmp(argv[ix], "--baseline") && ix+1 < argc)
+      basename = argv[++ix];
+    else if (!strcmp(argv[ix], "--slack") && ix+1 < argc)
+      slack = atof(argv[++ix]);
+    else if (!strcmp(argv[ix], "--record") && ix+1 < argc)
+      recordname = argv[++ix];
+    else if (!strcmp(argv[ix], "--runs") && ix+1 < argc)
+      runs = atoi(argv[++ix]);
+    else if (!strcmp(argv[ix], "--sums") && ix+1 < argc)
+      sumsname = argv[++ix];
+    else if (!strcmp(argv[ix], "--record-sum") && ix+1 < argc)
+      recordsumname = argv[++ix];
+    else if (!strcmp(argv[ix], "--resume") && ix+1 < argc)
+      resume = atoi(argv[++ix]);
+    else {
+      fprintf(stderr, "usage: %s [--steps N] [--seed N] "
+	"[--engine tree|block]\n"
+	"       [--trace FILE | --check FILE [--tolerance X]]\n"
+	"       [--baseline FILE [--slack PERCENT] | --record FILE] "
+	"[--runs N]\n"
+	"       [--sums FILE | --record-sum FILE] [--resume STEP]\n",
+	progname);
+      return 1;
+    }
+  }
+
+  if (tracename && checkname) {
+    fprintf(stderr, "%s: --trace and --check don't go together\n",
+      progname);
+    return 1;
+  }
+  if (runs < 1 || ((tracename || checkname) && runs > 1)) {
+    fprintf(stderr, "%s: --runs must be 1 with --trace or --check, and "
+      "at least 1 otherwise\n", progname);
+    return 1;
+  }
+
+  if (resume >= 0) {
+    if (resume >= steps) {
+      fprintf(stderr, "%s: --resume must come before --steps\n", progname);
+      return 1;
+    }
+    for (look = 0; move_look_name(look); look++) {
+      if (!check_resume(seed, look, resume, steps))
+	return 1;
+    }
+    printf("%s: seed %u: every look resumes at step %d exactly\n",
+      progname, seed, resume);
+    return 0;
+  }
+
+#ifdef OSC_COMPACT
+  sprintf(engine, "%s-compact", elist_blocks ? "block" : "tree");
+#else
+  sprintf(engine, "%s", elist_blocks ? "block" : "tree");
+#endif
+
+  if (tracename || checkname) {
+    tracefl = fopen(tracename ? tracename : checkname,
+      tracename ? "wb" : "rb");
+    if (!tracefl) {
+      fprintf(stderr, "%s: couldn't open %s\n", progname,
+	tracename ? tracename : checkname);
+      return 1;
+    }
+  }
+
+  for (run = 0; run < runs; run++) {
+    double runsecs;
+    sum = 0;
+    start = timer_msec();
+    for (look = 0; move_look_name(look); look++) {
+      if (!init_chain(&chain, seed, look))
+	return 1;
+      /* Each step is what a frame costs stonerview: one increment and one
+	 interpolation. */
+      for (step = 0; step < steps; step++) {
+	chain_increment(&chain);
+	chain_interpolate(&chain, list, 0.5);
+	if (tracefl && step % TRACE_EVERY == 0) {
+	  make_record(&rec);
+	  if (tracename) {
+	    if (fwrite(&rec, sizeof(rec), 1, tracefl) != 1) {
+	      fprintf(stderr, "%s: couldn't write %s\n", progname,
+		tracename);
+	      return 1;
+	    }
+	  }
+	  else {
+	    if (fread(&gold, sizeof(gold), 1, tracefl) != 1) {
+	      fprintf(stderr, "%s: %s ends early (at look %d, step %d)\n",
+		progname, checkname, look, step);
+	      return 1;
+	    }
+	    if (!compare_record(&rec, &gold, tolerance, &worst, look, step))
+	      return 1;
+	  }
+	}
+      }
+      sum = checksum(sum, list);
+      osc_free_graph(&chain.graph);
+    }
+    runsecs = (timer_msec() - start) / 1000.0;
+    if (run == 0 || runsecs < secs)
+      secs = runsecs;
+  }
+  nsec = (look * steps > 0) ? secs * 1.0e9 / (look * steps) : 0.0;
+
+  if (tracefl) {
+    if (checkname && fgetc(tracefl) != EOF) {
+      fprintf(stderr, "%s: %s has more steps than this run\n", progname,
+	checkname);
+      return 1;
+    }
+    fclose(tracefl);
+  }
+
+  printf("%s: %d looks x %d steps in %.3f seconds (%.0f steps/sec), "
+    "checksum %08lx\n", progname, look, steps, secs,
+    (secs > 0.0) ? look * steps / secs : 0.0, sum & 0xFFFFFFFFUL);
+  if (checkname)
+    printf("%s: %s matches %s (worst float error %g)\n", progname, engine,
+      checkname, worst);
+
+  if (recordname) {
+    FILE *fl = fopen(recordname, "a");
+    if (!fl) {
+      fprintf(stderr, "%s: couldn't open %s\n", progname, recordname);
+      return 1;
+    }
+    fprintf(fl, "%s %.0f\n", engine, nsec);
+    fclose(fl);
+  }
+  if (recordsumname) {
+    FILE *fl = fopen(recordsumname, "a");
+    if (!fl) {
+      fprintf(stderr, "%s: couldn't open %s\n", progname, recordsumname);
+      return 1;
+    }
+    fprintf(fl, "%u %d %08lx\n", seed, steps, sum & 0xFFFFFFFFUL);
+    fclose(fl);
+  }
+  if (sumsname && !check_sum(sumsname, seed, steps, sum))
+    return 1;
+  if (basename && !check_baseline(basename, engine, nsec, slack))
+    return 1;
+
+  return 0;
+}
+
+/* Fold the bits of every position and color into the sum. */
+static unsigned long checksum(unsigned long sum, elem_t *list)
+{
+  int ix, jx;
+
+  for (ix=0; ix<NUM_ELS; ix++) {
+    GLfloat vals[7];
+    unsigned char *cx = (unsigned char *)vals;
+    memcpy(vals, list[ix].pos, 3 * sizeof(GLfloat));
+    memcpy(vals+3, list[ix].col, 4 * sizeof(GLfloat));
+    for (jx=0; jx<sizeof(vals); jx++)
+      sum = (sum * 31 + cx[jx]) & 0xFFFFFFFFUL;
+  }
+  return sum;
+}
+
+/* Fill in a trace record from the chain and the list, reading the graph
+   the way the engine does. */
+static void make_record(tracerec_t *rec)
+{
+  osc_t *params[4];
+  int ix, jx;
+
+  params[0] = chain.theta;
+  params[1] = chain.rad;
+  params[2] = chain.alti;
+  params[3] = chain.color;
+
+  memset(rec, 0, sizeof(tracerec_t));
+  for (jx=0; jx<4; jx++) {
+    if (elist_blocks) {
+      osc_get_block(params[jx], rec->vals[jx]);
+    }
+    else {
+      for (ix=0; ix<NUM_ELS; ix++)
+	rec->vals[jx][ix] = osc_get(params[jx], ix);
+    }
+  }
+  for (ix=0; ix<NUM_ELS; ix++) {
+    memcpy(rec->pos[ix], list[ix].pos, sizeof(rec->pos[ix]));
+    memcpy(rec->col[ix], list[ix].col, sizeof(rec->col[ix]));
+  }
+}
+
+static int compare_record(tracerec_t *rec, tracerec_t *gold, double tol,
+  double *worst, int look, int step)
+{
+  static char *paramnames[4] = { "theta", "rad", "alti", "color" };
+  int ix, jx;
+  double diff;
+
+  for (jx=0; jx<4; jx++) {
+    for (ix=0; ix<NUM_ELS; ix++) {
+      if (rec->vals[jx][ix] != gold->vals[jx][ix]) {
+	fprintf(stderr, "%s: look %s, step %d, polygon %d: %s is %d, "
+	  "should be %d\n", progname, move_look_name(look), step, ix,
+	  paramnames[jx], rec->vals[jx][ix], gold->vals[jx][ix]);
+	return FALSE;
+      }
+    }
+  }
+
+  for (ix=0; ix<NUM_ELS; ix++) {
+    for (jx=0; jx<7; jx++) {
+      GLfloat val = (jx < 3) ? rec->pos[ix][jx] : rec->col[ix][jx-3];
+      GLfloat goldval = (jx < 3) ? gold->pos[ix][jx] : gold->col[ix][jx-3];
+      diff = fabs((double)val - (double)goldval);
+      if (diff > *worst)
+	*worst = diff;
+      if (!(diff <= tol)) {
+	fprintf(stderr, "%s: look %s, step %d, polygon %d: %s[%d] is %g, "
+	  "should be %g\n", progname, move_look_name(look), step, ix,
+	  (jx < 3) ? "pos" : "col", (jx < 3) ? jx : jx-3, val, goldval);
+	return FALSE;
+      }
+    }
+  }
+
+  return TRUE;
+}
+
+/* Find this engine's line in the baseline file, and see whether we're
+   within the slack of it. An engine that isn't listed passes, with a
+   note. */
+static int check_baseline(char *filename, char *engine, double nsec,
+  double slack)
+{
+  FILE *fl = fopen(filename, "r");
+  char buf[256], name[64];
+  double base;
+
+  if (!fl) {
+    fprintf(stderr, "%s: couldn't open %s\n", progname, filename);
+    return FALSE;
+  }
+
+  while (fgets(buf, sizeof(buf), fl)) {
+    if (buf[0] == '#')
+      continue;
+    if (sscanf(buf, "%63s %lf", name, &base) != 2 || strcmp(name, engine))
+      continue;
+    fclose(fl);
+    if (nsec > base * (1.0 + slack / 100.0)) {
+      fprintf(stderr, "%s: %s takes %.0f ns/step, more than %.0f%% over "
+	"the baseline of %.0f\n", progname, engine, nsec, slack, base);
+      return FALSE;
+    }
+    printf("%s: %s takes %.0f ns/step (baseline %.0f)\n", progname, engine,
+      nsec, base);
+    return TRUE;
+  }
+
+  fclose(fl);
+  printf("%s: %s takes %.0f ns/step (not in %s)\n", progname, engine, nsec,
+    filename);
+  return TRUE;
+}
+
+/* Find the line for this seed and step count in the checksum file, and
+   see whether we match it. Unlike the baseline, a missing line is a
+   failure: the point is to notice when the output has moved. */
+static int check_sum(char *filename, unsigned int seed, int steps,
+  unsigned long sum)
+{
+  FILE *fl = fopen(filename, "r");
+  char buf[256];
+  unsigned int fseed;
+  int fsteps;
+  unsigned long fsum;
+
+  if (!fl) {
+    fprintf(stderr, "%s: couldn't open %s\n", progname, filename);
+    return FALSE;
+  }
+
+  sum &= 0xFFFFFFFFUL;
+  while (fgets(buf, sizeof(buf), fl)) {
+    if (buf[0] == '#')
+      continue;
+    if (sscanf(buf, "%u %d %lx", &fseed, &fsteps, &fsum) != 3
+      || fseed != seed || fsteps != steps)
+      continue;
+    fclose(fl);
+    if (fsum != sum) {
+      fprintf(stderr, "%s: seed %u, %d steps: checksum %08lx, but %s "
+	"says %08lx\n", progname, seed, steps, sum, filename, fsum);
+      return FALSE;
+    }
+    printf("%s: seed %u, %d steps: checksum matches %s\n", progname, seed,
+      steps, filename);
+    return TRUE;
+  }
+
+  fclose(fl);
+  fprintf(stderr, "%s: no checksum for seed %u, %d steps in %s\n",
+    progname, seed, steps, filename);
+  return FALSE;
+}
+
+/* Run a look to step resume, save it, load it into a second chain, and
+   run both to the end, comparing as we go. */
+static int check_resume(unsigned int seed, int look, int resume,
+  int steps)
+{
+  static chain_t loaded;
+  FILE *fl;
+  int step, ok = TRUE;
+
+  if (!init_chain(&chain, seed, look) || !init_chain(&loaded, seed+1, look))
+    return FALSE;
+  for (step = 0; step < resume; step++)
+    chain_increment(&chain);
+
+  fl = tmpfile();
+  if (!fl) {
+    perror("tmpfile");
+    return FALSE;
+  }
+  chain_save(&chain, fl);
+  rewind(fl);
+  if (!chain_load(&loaded, fl)) {
+    fprintf(stderr, "%s: look %s: couldn't load what was saved\n",
+      progname, move_look_name(look));
+    ok = FALSE;
+  }
+  fclose(fl);
+
+  for (step = resume; ok && step < steps; step++) {
+    if (memcmp(chain.cur, loaded.cur, sizeof(chain.cur))) {
+      fprintf(stderr, "%s: look %s: the loaded run differs at step %d\n",
+	progname, move_look_name(look), step);
+      ok = FALSE;
+    }
+    chain_increment(&chain);
+    chain_increment(&loaded);
+  }
+
+  osc_free_graph(&chain.graph);
+  osc_free_graph(&loaded.graph);
+  return ok;
+}
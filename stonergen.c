@@ -0,0 +1,210 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+/* stonerview-gen: run the simulation for many seeds at once, with no
+   display, and write every frame of every one to a file.
+
+     stonerview-gen --seeds S --frames F [--threads T] [--first-seed N]
+       [--look NAME] FILE
+
+   Seed n is the chain that init_move() would build from that seed. The
+   file is a genheader_t, and then S*F frames of NUM_ELS elem_t polygons,
+   seed by seed and frame by frame within each seed -- so frame f of the
+   i'th seed is at a place anyone can work out. The numbers are floats in
+   the byte order of the machine that wrote them.
+
+   The whole file is allocated up front and mapped into memory, and each
+   worker thread takes every T'th seed and has chain_interpolate() write
+   its frames straight into the map. No two threads touch the same
+   bytes, so there's nothing to lock and nothing to copy. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <GL/gl.h>
+
+#include "general.h"
+#include "osc.h"
+#include "move.h"
+#include "timer.h"
+
+#define GEN_MAGIC "STVG"
+#define GEN_VERSION (1)
+
+/* The start of the file. The frames begin right after it, at a 64-byte
+   boundary. */
+typedef struct genheader_struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t numels; /* polygons per frame */
+  uint32_t elemsize; /* bytes per polygon: pos[3], vervec[2], col[4] */
+  uint32_t seeds;
+  uint32_t frames; /* per seed */
+  uint32_t firstseed;
+  uint32_t look;
+  uint32_t reserved[8];
+} genheader_t;
+
+#define FRAME_SIZE (NUM_ELS * sizeof(elem_t))
+
+char *progname = NULL;
+
+static int seeds = 0, frames = 0, threads = 1;
+static unsigned int firstseed = 1;
+static int look = 0;
+static unsigned char *frameblock = NULL;
+static int failed = FALSE;
+
+static void *gen_thread(void *rock);
+
+static void usage()
+{
+  fprintf(stderr,
+    "usage: %s --seeds S --frames F [--threads T] [--first-seed N]\n"
+    "       [--look NAME] FILE\n", progname);
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  char *filename = NULL;
+  pthread_t *workers;
+  genheader_t *header;
+  unsigned char *map;
+  size_t size;
+  double start, secs;
+  int ix, fd, res;
+
+  progname = argv[0];
+
+  for (ix=1; ix<argc; ix++) {
+    if (!strcmp(argv[ix], "--seeds") && ix+1 < argc)
+      seeds = atoi(argv[++ix]);
+    else if (!strcmp(argv[ix], "--frames") && ix+1 < argc)
+      frames = atoi(argv[++ix]);
+    else if (!strcmp(argv[ix], "--threads") && ix+1 < argc)
+      threads = atoi(argv[++ix]);
+    else if (!strcmp(argv[ix], "--first-seed") && ix+1 < argc)
+      firstseed = strtoul(argv[++ix], NULL, 10);
+    else if (!strcmp(argv[ix], "--look") && ix+1 < argc) {
+      look = move_find_look(argv[++ix]);
+      if (look < 0)
+	usage();
+    }
+    else if (argv[ix][0] != '-' && !filename)
+      filename = argv[ix];
+    else
+      usage();
+  }
+  if (!filename || seeds < 1 || frames < 1 || threads < 1)
+    usage();
+  if (threads > seeds)
+    threads = seeds;
+
+  size = sizeof(genheader_t) + (size_t)seeds * frames * FRAME_SIZE;
+
+  fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) {
+    perror(filename);
+    return 1;
+  }
+  /* Really allocate the space, so that running out of disk is an error
+     now rather than a SIGBUS later. Not every filesystem can. */
+  res = posix_fallocate(fd, 0, size);
+  if (res == EOPNOTSUPP || res == EINVAL)
+    res = (ftruncate(fd, size) < 0) ? errno : 0;
+  if (res) {
+    fprintf(stderr, "%s: %s: %s\n", progname, filename, strerror(res));
+    return 1;
+  }
+  map = (unsigned char *)mmap(NULL, size, PROT_READ | PROT_WRITE,
+    MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  close(fd);
+
+  header = (genheader_t *)map;
+  memset(header, 0, sizeof(genheader_t));
+  memcpy(header->magic, GEN_MAGIC, 4);
+  header->version = GEN_VERSION;
+  header->numels = NUM_ELS;
+  header->elemsize = sizeof(elem_t);
+  header->seeds = seeds;
+  header->frames = frames;
+  header->firstseed = firstseed;
+  header->look = look;
+  frameblock = map + sizeof(genheader_t);
+
+  workers = (pthread_t *)malloc(threads * sizeof(pthread_t));
+  if (!workers)
+    return 1;
+
+  start = timer_msec();
+  for (ix=0; ix<threads; ix++) {
+    if (pthread_create(&workers[ix], NULL, gen_thread,
+	(void *)(intptr_t)ix)) {
+      fprintf(stderr, "%s: couldn't start a worker thread\n", progname);
+      return 1;
+    }
+  }
+  for (ix=0; ix<threads; ix++)
+    pthread_join(workers[ix], NULL);
+  secs = (timer_msec() - start) / 1000.0;
+
+  munmap(map, size);
+  if (failed)
+    return 1;
+
+  fprintf(stderr, "%s: %d seeds x %d frames on %d threads in %.2f seconds "
+    "(%.0f elements/sec)\n", progname, seeds, frames, threads, secs,
+    (secs > 0.0) ? (double)seeds * frames * NUM_ELS / secs : 0.0);
+  return 0;
+}
+
+/* One worker: seeds ix, ix+threads, ix+2*threads, and so on, each in a
+   chain of our own. */
+static void *gen_thread(void *rock)
+{
+  int ix = (int)(intptr_t)rock;
+  chain_t *chain;
+  int seed, frame;
+
+  chain = (chain_t *)malloc(sizeof(chain_t));
+  if (!chain) {
+    failed = TRUE;
+    return NULL;
+  }
+
+  for (seed = ix; seed < seeds; seed += threads) {
+    elem_t *dest = (elem_t *)(frameblock
+      + (size_t)seed * frames * FRAME_SIZE);
+    if (!init_chain(chain, firstseed + seed, look)) {
+      failed = TRUE;
+      break;
+    }
+    /* Frame 0 is the chain as it starts, the way stonerview --export
+       draws it. */
+    for (frame = 0; frame < frames; frame++) {
+      if (frame)
+	chain_increment(chain);
+      chain_interpolate(chain, dest, 1.0);
+      dest += NUM_ELS;
+    }
+    osc_free_graph(&chain->graph);
+  }
+
+  free(chain);
+  return NULL;
+}
@@ -0,0 +1,60 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+/* An example reader for "stonerview --publish NAME". It prints a summary
+   of the current frame a few times a second:
+
+     stonerpeek NAME
+*/
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "stonerpub.h"
+
+int main(int argc, char *argv[])
+{
+  stonerpub_t *pub;
+  uint64_t lastframe = 0;
+
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s NAME\n", argv[0]);
+    return 1;
+  }
+
+  pub = stonerpub_open(argv[1]);
+  if (!pub)
+    return 1;
+
+  while (1) {
+    stonerpub_frame_t fr;
+
+    if (stonerpub_begin(pub, &fr)) {
+      /* Read straight out of shared memory. We only keep what we've read
+	 if the frame is still intact afterwards. */
+      const stonerpub_elem_t *head = &fr.el[0];
+      const stonerpub_elem_t *tail = &fr.el[fr.numels-1];
+      float hx = head->pos[0], hy = head->pos[1], hz = head->pos[2];
+      float tx = tail->pos[0], ty = tail->pos[1], tz = tail->pos[2];
+      float r = head->col[0], g = head->col[1], b = head->col[2];
+
+      if (stonerpub_end(pub, &fr)) {
+	printf("frame %lu (+%lu): head (%.3f, %.3f, %.3f) "
+	  "rgb (%.2f, %.2f, %.2f); tail (%.3f, %.3f, %.3f)\n",
+	  (unsigned long)fr.frame, (unsigned long)(fr.frame - lastframe),
+	  hx, hy, hz, r, g, b, tx, ty, tz);
+	fflush(stdout);
+	lastframe = fr.frame;
+      }
+    }
+
+    usleep(200000);
+  }
+
+  stonerpub_close(pub);
+  return 0;
+}
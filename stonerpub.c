@@ -0,0 +1,140 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+/* The reader library for the shared-memory segment that --publish writes.
+   See stonerpub.h for how to use it. This doesn't depend on anything
+   else in StonerView, so you can drop it into another program. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "stonerpub.h"
+
+struct stonerpub_struct {
+  void *base;
+  size_t size;
+  stonerpub_header_t *header;
+};
+
+/* How many times stonerpub_begin() tries before it decides that the
+   newest slot is always being written. That would be weird, but we don't
+   want to spin forever. */
+#define BEGIN_TRIES (16)
+
+static const stonerpub_slot_t *get_slot(stonerpub_t *pub, uint64_t frame)
+{
+  stonerpub_header_t *hdr = pub->header;
+  return (const stonerpub_slot_t *)((char *)pub->base + sizeof(*hdr)
+    + (frame % hdr->numslots) * hdr->slotsize);
+}
+
+/* Open the segment that "stonerview --publish NAME" is writing. Returns
+   NULL (and prints a message) if it isn't there, or isn't something we
+   understand. */
+stonerpub_t *stonerpub_open(const char *name)
+{
+  char buf[256];
+  int fd;
+  struct stat st;
+  stonerpub_t *pub;
+  stonerpub_header_t *hdr;
+
+  if (name[0] == '/')
+    snprintf(buf, sizeof(buf), "%s", name);
+  else
+    snprintf(buf, sizeof(buf), "/%s", name);
+
+  fd = shm_open(buf, O_RDONLY, 0);
+  if (fd < 0) {
+    perror(buf);
+    return NULL;
+  }
+  if (fstat(fd, &st) < 0 || st.st_size < sizeof(stonerpub_header_t)) {
+    fprintf(stderr, "%s: not a StonerView segment\n", buf);
+    close(fd);
+    return NULL;
+  }
+
+  pub = (stonerpub_t *)malloc(sizeof(stonerpub_t));
+  if (!pub) {
+    close(fd);
+    return NULL;
+  }
+  pub->size = st.st_size;
+  pub->base = mmap(NULL, pub->size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (pub->base == MAP_FAILED) {
+    perror(buf);
+    free(pub);
+    return NULL;
+  }
+
+  hdr = (stonerpub_header_t *)pub->base;
+  pub->header = hdr;
+  if (hdr->magic != STONERPUB_MAGIC || hdr->version != STONERPUB_VERSION
+    || hdr->numslots == 0
+    || hdr->slotsize < STONERPUB_SLOTSIZE(hdr->numels)
+    || sizeof(*hdr) + (size_t)hdr->numslots * hdr->slotsize > pub->size) {
+    fprintf(stderr, "%s: not a StonerView segment (or the wrong version)\n",
+      buf);
+    stonerpub_close(pub);
+    return NULL;
+  }
+
+  return pub;
+}
+
+void stonerpub_close(stonerpub_t *pub)
+{
+  munmap(pub->base, pub->size);
+  free(pub);
+}
+
+/* Find the newest complete frame, and fill in fr to point at it. Returns
+   0 if there's nothing to look at yet. */
+int stonerpub_begin(stonerpub_t *pub, stonerpub_frame_t *fr)
+{
+  int tries;
+
+  for (tries = 0; tries < BEGIN_TRIES; tries++) {
+    uint64_t frame = __atomic_load_n(&pub->header->latest, __ATOMIC_ACQUIRE);
+    const stonerpub_slot_t *slot;
+    uint32_t seq;
+
+    if (frame == 0)
+      return 0;
+
+    slot = get_slot(pub, frame);
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+      continue; /* being written right now */
+    if (slot->frame != frame)
+      continue; /* already reused for a newer frame */
+
+    fr->frame = frame;
+    fr->numels = pub->header->numels;
+    fr->el = slot->el;
+    fr->slot = slot;
+    fr->seq = seq;
+    return 1;
+  }
+
+  return 0;
+}
+
+/* Check that the frame we were looking at wasn't overwritten while we
+   were looking. Returns 1 if what we saw was good. */
+int stonerpub_end(stonerpub_t *pub, stonerpub_frame_t *fr)
+{
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return (__atomic_load_n(&fr->slot->seq, __ATOMIC_RELAXED) == fr->seq);
+}
@@ -0,0 +1,80 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+/* The layout of the shared-memory segment that "stonerview --publish NAME"
+   writes, and a tiny library for reading it from another process.
+
+   The segment is a header followed by a ring of slots. Each slot holds one
+   frame's list of polygons, with the same fields as elem_t in move.h.
+   StonerView writes frame after frame into the ring and never waits for
+   anybody. Each slot has a sequence number which is odd while StonerView
+   is writing it, and bumped to even when it's done. So a reader looks at
+   the newest frame in place, and then checks that the sequence number
+   didn't change while it was looking. If it did, the frame was torn and
+   the reader should try again; it just skips to whatever is newest.
+
+   A reader goes like this:
+
+     stonerpub_t *pub = stonerpub_open("NAME");
+     stonerpub_frame_t fr;
+     if (stonerpub_begin(pub, &fr)) {
+       ... look at fr.el[0] through fr.el[fr.numels-1] ...
+       if (!stonerpub_end(pub, &fr))
+         ... it changed underneath us; discard what we saw ...
+     }
+     stonerpub_close(pub);
+*/
+
+#include <stdint.h>
+
+#define STONERPUB_MAGIC (0x53545650) /* "STVP" */
+#define STONERPUB_VERSION (1)
+#define STONERPUB_SLOTS (4)
+
+typedef struct stonerpub_elem_struct {
+  float pos[3];
+  float vervec[2];
+  float col[4];
+} stonerpub_elem_t;
+
+typedef struct stonerpub_header_struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t numels; /* polygons per frame */
+  uint32_t numslots;
+  uint32_t slotsize; /* bytes per slot, including the slot header */
+  uint32_t reserved;
+  uint64_t latest; /* number of the newest complete frame; 0 if none yet */
+} stonerpub_header_t;
+
+typedef struct stonerpub_slot_struct {
+  uint32_t seq; /* odd while the slot is being written */
+  uint32_t reserved;
+  uint64_t frame; /* the frame number in this slot */
+  stonerpub_elem_t el[1]; /* really numels of these */
+} stonerpub_slot_t;
+
+#define STONERPUB_SLOTSIZE(numels) \
+  (sizeof(stonerpub_slot_t) + ((numels)-1) * sizeof(stonerpub_elem_t))
+
+/* The reader's side. */
+
+typedef struct stonerpub_struct stonerpub_t;
+
+typedef struct stonerpub_frame_struct {
+  uint64_t frame;
+  int numels;
+  const stonerpub_elem_t *el; /* points straight into shared memory */
+
+  const stonerpub_slot_t *slot; /* private */
+  uint32_t seq; /* private */
+} stonerpub_frame_t;
+
+extern stonerpub_t *stonerpub_open(const char *name);
+extern void stonerpub_close(stonerpub_t *pub);
+extern int stonerpub_begin(stonerpub_t *pub, stonerpub_frame_t *fr);
+extern int stonerpub_end(stonerpub_t *pub, stonerpub_frame_t *fr);
@@ -22,40 +22,287 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <math.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/timerfd.h>
 
 #include <GL/gl.h>
 
 #include "general.h"
+#include "osc.h"
 #include "move.h"
 #include "view.h"
+#include "timer.h"
+#include "governor.h"
+#include "publish.h"
+#include "export.h"
+#include "state.h"
+#include "control.h"
 
-#define FRAMERATE (20) /* milliseconds per frame */
+static double last_time = 0.0; /* when we last ran do_frame() */
+static double lag = 0.0; /* simulated time we owe, in milliseconds */
 
-static void screenhack_usleep(unsigned long usecs);
+/* Set when we get SIGINT or SIGTERM. We leave through exit() at the next
+   chance, so that the atexit() handlers get to clean up and save. */
+static volatile sig_atomic_t quitting = FALSE;
+/* Set when we get SIGHUP, which asks for the next look. */
+static volatile sig_atomic_t swapping = FALSE;
+/* The handlers also write a byte down this pipe, which the main loop
+   polls. A signal that comes after we've checked the flags, but before
+   we're asleep, still wakes us. (It may be some other thread that takes
+   the signal, so poll() getting EINTR isn't enough.) */
+static int wakepipe[2] = { -1, -1 };
+
+static void catch_quit(int sig);
+static void catch_swap(int sig);
+static void wake_up(void);
+static void set_timer(int fd, int running);
+static void do_frame(void);
+static void run_export(void);
 
 int main(int argc, char *argv[])
 {
+  int timerfd, ix;
+  int running = FALSE;
+
+  timer_mark("start");
   srand(time(NULL));
 
   if (!init_view(&argc, argv))
     return -1;
   if (!init_move())
     return -1;
+  timer_mark("simulation");
+  if (!init_publish())
+    return -1;
+  if (!init_state())
+    return -1;
+  if (!init_control())
+    return -1;
+  init_governor();
+  timer_mark("services");
+
+  if (pipe(wakepipe) < 0) {
+    perror("pipe");
+    return -1;
+  }
+  for (ix = 0; ix < 2; ix++) {
+    fcntl(wakepipe[ix], F_SETFL, O_NONBLOCK);
+    fcntl(wakepipe[ix], F_SETFD, FD_CLOEXEC);
+  }
+
+  {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = catch_quit;
+    /* No SA_RESTART, so that poll() wakes up. */
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = catch_swap;
+    sigaction(SIGHUP, &sa, NULL);
+  }
+
+  if (export_file) {
+    run_export();
+    return 0;
+  }
+
+  timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timerfd < 0) {
+    perror("timerfd_create");
+    return -1;
+  }
 
+  /* We sleep in poll() until either the frame timer fires or the X server
+     has something to say. When the window can't be seen, the timer is
+     turned off, and we sleep until it can be seen again. */
   while (1) {
+    struct pollfd fds[4];
+    int nfds = 0;
+    int timerix = -1, controlix = -1;
+
+    view_events();
+
+    if (view_visible() && !running) {
+      running = TRUE;
+      /* Pick up where we left off. Don't try to make up the time we
+	 spent hidden. */
+      last_time = timer_msec();
+      set_timer(timerfd, TRUE);
+    }
+    else if (!view_visible() && running) {
+      running = FALSE;
+      set_timer(timerfd, FALSE);
+    }
+
+    fds[nfds].fd = view_fd();
+    fds[nfds].events = POLLIN;
+    nfds++;
+    fds[nfds].fd = wakepipe[0];
+    fds[nfds].events = POLLIN;
+    nfds++;
+    if (running) {
+      timerix = nfds;
+      fds[nfds].fd = timerfd;
+      fds[nfds].events = POLLIN;
+      nfds++;
+    }
+    if (control_fd() >= 0) {
+      controlix = nfds;
+      fds[nfds].fd = control_fd();
+      fds[nfds].events = POLLIN;
+      nfds++;
+    }
+
+    /* Empty the pipe before looking at the flags, so that anything
+       after this point leaves a byte in it. */
+    {
+      char buf[16];
+      while (read(wakepipe[0], buf, sizeof(buf)) > 0)
+	;
+    }
+    if (quitting)
+      exit(0);
+    if (swapping) {
+      swapping = FALSE;
+      move_swap(-1);
+    }
+
+    if (poll(fds, nfds, -1) < 0) {
+      if (errno == EINTR)
+	continue;
+      perror("poll");
+      return -1;
+    }
+
+    if (controlix >= 0 && (fds[controlix].revents & POLLIN))
+      control_read();
+
+    if (timerix >= 0 && (fds[timerix].revents & POLLIN)) {
+      uint64_t expirations;
+      /* If we're running slow, several expirations may have piled up;
+	 we draw just one frame for all of them. */
+      if (read(timerfd, &expirations, sizeof(expirations)) > 0)
+	do_frame();
+    }
+  }
+
+  return 0;
+}
+
+/* Draw frames as fast as we can, one per simulation step, and send them
+   off to the export file. */
+static void run_export()
+{
+  int frame;
+  double start, secs;
+
+  if (!init_export())
+    exit(1);
+
+  start = timer_msec();
+  for (frame = 0; (export_frames == 0 || frame < export_frames)
+	 && !quitting; frame++) {
+    if (swapping) {
+      swapping = FALSE;
+      move_swap(-1);
+    }
+    if (control_fd() >= 0)
+      control_read();
+    move_interpolate(1.0);
     win_draw();
+    publish_frame();
+    if (frame == 0) {
+      timer_mark("first frame");
+      timer_report();
+    }
     move_increment();
-    screenhack_usleep(FRAMERATE * 1000L);
   }
 
-  return 0;
+  win_flush();
+  final_export();
+
+  secs = (timer_msec() - start) / 1000.0;
+  fprintf(stderr, "%s: exported %d frames in %.2f seconds (%.1f fps)\n",
+    progname, frame, secs, (secs > 0.0) ? frame / secs : 0.0);
+}
+
+static void catch_quit(int sig)
+{
+  quitting = TRUE;
+  wake_up();
+}
+
+static void catch_swap(int sig)
+{
+  swapping = TRUE;
+  wake_up();
 }
 
-static void screenhack_usleep(unsigned long usecs)
+static void wake_up()
 {
-  struct timeval tv;
-  tv.tv_sec  = usecs / 1000000L;
-  tv.tv_usec = usecs % 1000000L;
-  select(0, 0, 0, 0, &tv);
+  int saved = errno;
+  if (write(wakepipe[1], "", 1) < 0) {
+    /* The pipe is full, so the main loop will wake anyway. */
+  }
+  errno = saved;
+}
+
+/* Turn the periodic frame timer on or off. */
+static void set_timer(int fd, int running)
+{
+  struct itimerspec its;
+  long nsec = (long)(frame_ms * 1000000.0);
+
+  memset(&its, 0, sizeof(its));
+  if (running) {
+    its.it_interval.tv_sec = nsec / 1000000000L;
+    its.it_interval.tv_nsec = nsec % 1000000000L;
+    /* The first frame comes right away; there's no reason to stare at
+       an empty window for a frame's worth of time. (Zero would disarm
+       the timer, so make it a nanosecond.) */
+    its.it_value.tv_nsec = 1;
+  }
+  timerfd_settime(fd, 0, &its, NULL);
+}
+
+/* The simulation steps at a fixed rate (TICKRATE), however fast or slow
+   we manage to draw. lag is how much simulated time we owe; each frame
+   we pay it off in whole steps, and draw partway between the last two
+   steps according to the remainder. */
+static void do_frame()
+{
+  double start = timer_msec();
+  double tick = TICKRATE * gov_tickdiv;
+  int steps = 0;
+
+  lag += (start - last_time);
+  last_time = start;
+  while (lag >= tick && steps < MAX_CATCHUP) {
+    move_increment();
+    lag -= tick;
+    steps++;
+  }
+  if (lag >= tick) {
+    /* We've fallen too far behind to catch up. Let the excess go, rather
+       than running the simulation flat out. */
+    lag = fmod(lag, tick);
+  }
+
+  move_interpolate(lag / tick);
+  win_draw();
+  publish_frame();
+  if (startup_profile) {
+    timer_mark("first frame");
+    timer_report();
+  }
+
+  governor_frame(timer_msec() - start);
 }
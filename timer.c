@@ -0,0 +1,69 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include <GL/gl.h>
+
+#include "general.h"
+#include "view.h"
+#include "timer.h"
+
+/* Return the current time in milliseconds. The zero point is arbitrary;
+   this is only good for measuring intervals. It's a monotonic clock, so
+   it doesn't jump around when someone sets the system time. */
+double timer_msec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+}
+
+/* --startup-profile: note the time as each phase of startup finishes,
+   and print the lot once the first frame is on the screen. */
+
+#define MAX_MARKS (16)
+
+int startup_profile = FALSE;
+
+static struct {
+  char *phase;
+  double msec;
+} marks[MAX_MARKS];
+static int num_marks = 0;
+
+/* Note that a phase just finished. The first mark is the starting line.
+   This is cheap enough to call whether or not we're profiling. */
+void timer_mark(char *phase)
+{
+  if (num_marks < MAX_MARKS) {
+    marks[num_marks].phase = phase;
+    marks[num_marks].msec = timer_msec();
+    num_marks++;
+  }
+}
+
+/* Print the time taken by each phase, and the total. Only the first call
+   does anything. */
+void timer_report()
+{
+  static int reported = FALSE;
+  int ix;
+
+  if (!startup_profile || reported || num_marks < 2)
+    return;
+  reported = TRUE;
+  /* And there's no point in marking anything after this. */
+
+  fprintf(stderr, "%s: time to first frame:\n", progname);
+  for (ix = 1; ix < num_marks; ix++)
+    fprintf(stderr, "  %-16s %8.2f ms\n", marks[ix].phase,
+      marks[ix].msec - marks[ix-1].msec);
+  fprintf(stderr, "  %-16s %8.2f ms\n", "total",
+    marks[num_marks-1].msec - marks[0].msec);
+  num_marks = MAX_MARKS;
+}
@@ -0,0 +1,12 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+extern double timer_msec(void);
+
+extern int startup_profile;
+extern void timer_mark(char *phase);
+extern void timer_report(void);
@@ -10,89 +10,151 @@
 #include <string.h>
 #include <math.h>
 
-#include <X11/Xlib.h>
-#include <X11/Xutil.h>
-#include <X11/Xatom.h>
-#include <X11/keysym.h>
+#define GL_GLEXT_PROTOTYPES
 #include <GL/gl.h>
-#include <GL/glx.h>
 
 #include "general.h"
 #include "osc.h"
 #include "view.h"
-#include "vroot.h"
+#include "backend.h"
+#include "timer.h"
+#include "governor.h"
+#include "gpuprof.h"
+#include "publish.h"
+#include "export.h"
+#include "pool.h"
+#include "state.h"
+#include "control.h"
 
 #include "move.h"
+#include "soft.h"
+#include "packed.h"
+#include "vk.h"
 
-static char *progclass = "StonerView";
-static char *progname = NULL;
+char *progname = NULL;
 
 static GLfloat view_rotx = -45.0, view_roty = 0.0, view_rotz = 0.0;
 static GLfloat view_scale = 4.0;
 
 static void setup_window(void);
-
-static void win_reshape(int width, int height);
-static void handle_events(void);
-
-static Display *dpy;
-static Window window;
+static void show_soft(void);
+
+static void autoscale_frame(double ms);
+static void transform_aspect(GLfloat aspect, GLfloat *mvp, GLfloat *light);
+static void draw_grid(void);
+static void scene_pass(int order, int faces, int edges, GLfloat light,
+  GLfloat *edgecol);
+static void scene_edge(elem_t *el, GLfloat *edgecol);
+static void scene_face(elem_t *el, GLfloat light);
+static void grid_build_one(int ix, void *rock);
+static void matrix_mult(GLfloat *res, GLfloat *a, GLfloat *b);
+static void matrix_rotate(GLfloat *res, GLfloat angle, GLfloat x, GLfloat y,
+  GLfloat z);
+
+static backend_t *backend = NULL;
 static int wireframe = FALSE;
 static int addedges = FALSE;
 
-static Atom XA_WM_PROTOCOLS, XA_WM_DELETE_WINDOW;
+/* Milliseconds per drawn frame. This is independent of the simulation
+   rate. */
+double frame_ms = FRAMERATE;
+
+/* These knobs belong to the quality governor. edges_allowed can turn off
+   the edges that --edges asked for, and draw_stride skips elements. */
+static int edges_allowed = TRUE;
+static int draw_stride = 1;
+
+/* On a fill-rate-bound display, we can draw into an offscreen framebuffer
+   at a fraction of the window size, and then stretch that onto the
+   window. render_scale is that fraction; 1.0 means draw straight into the
+   window as usual. */
+static GLfloat render_scale = 1.0;
+static GLfloat render_scale_limit = 1.0; /* the governor's cap */
+static int render_scale_auto = FALSE;
+static int have_fbo = FALSE;
+static GLuint fbo = 0, fbo_color = 0, fbo_depth = 0;
+static int fbo_width = 0, fbo_height = 0;
+static int win_width = 0, win_height = 0;
+
+/* With --renderer soft, we don't use GL at all. soft.c draws, and the
+   backend shows the result. */
+static int soft = FALSE;
+/* --renderer vulkan is the same, except that vk.c does the drawing. */
+static int vulkan = FALSE;
+
+/* Grid mode: one vertex for each corner of each face, and two for each
+   side of each edge, for every element of every tile. */
+typedef struct gridvert_struct {
+  GLfloat pos[4]; /* clip space */
+  GLubyte col[4];
+} gridvert_t;
+
+static gridvert_t *grid_faces = NULL;
+static gridvert_t *grid_edges = NULL;
+static GLfloat grid_mvp[16], grid_light;
+static int grid_edged = FALSE;
+static int grid_kept = NUM_ELS; /* elements per tile that draw_stride keeps */
+
+/* With --prelit, GL lighting is off. Every square faces the same way, so
+   the light is the same for all of them; we work it out once a frame and
+   scale the colors ourselves. */
+static int prelit = FALSE;
+
+/* With --packed, polygons go to GL as compact instance records, drawn by
+   packed.c. */
+static int packed = FALSE;
+
+/* Normally, when the squares can be drawn from the bottom up, we skip the
+   depth buffer (see view_painter_order()). --depth-test always uses it. */
+static int depth_test = FALSE;
+
+/* When exporting, the window is never shown; we always draw offscreen, and
+   read the result back instead of swapping. */
+static int offscreen = FALSE;
+
+#define MIN_RENDER_SCALE (0.25)
+
+/* In auto mode, we try to keep the drawing time of each frame below this
+   many milliseconds. That leaves the rest of the frame for the simulation
+   and the X server. */
+#define AUTOSCALE_TARGET (frame_ms * 0.75)
+/* ...and we reconsider the scale only this often (in frames), so that we
+   aren't reallocating the framebuffer constantly. */
+#define AUTOSCALE_PERIOD (25)
 
 
 static void usage(void)
 {
   fprintf(stderr,
-    "usage: %s [--geom =WxH+X+Y | --fullscreen | --root] [--wire]\n",
+    "usage: %s [--geom =WxH+X+Y | --fullscreen | --root] [--wire]\n"
+    "       [--edges] [--render-scale 0.25-1.0 | --render-scale auto]\n"
+    "       [--budget MS] [--fps N] [--publish NAME]\n"
+    "       [--export FILE.y4m|FILE.ppm|- [--frames N] [--size WxH]]\n"
+    "       [--renderer gl|soft|vulkan] [--threads N] [--backend x11|egl]\n"
+    "       [--head DISPLAY@DEGREES ...] [--grid COLSxROWS] [--packed]\n"
+    "       [--prelit] [--load-state FILE] [--save-state FILE]\n"
+    "       [--look NAME] [--crossfade TICKS] [--control SOCKET]\n"
+    "       [--startup-profile] [--gpu-profile] [--depth-test]\n"
+    "       [--loop-cache MB]\n",
     progname);
   exit(1);
 }
 
 
-static int visual_depth(Display *dpy, int screen, Visual *visual)
-{
-  XVisualInfo vi_in, *vi_out;
-  int out_count, depth;
-
-  vi_in.screen = screen;
-  vi_in.visualid = XVisualIDFromVisual(visual);
-
-  vi_out = XGetVisualInfo(dpy, (VisualScreenMask | VisualIDMask),
-    &vi_in, &out_count);
-  if (!vi_out)
-    return -1;
-
-  depth = vi_out[0].depth;
-  XFree(vi_out);
-
-  return depth;
-}
-
-#define UNDEF (-65536)
-
 int init_view(int *argc, char *argv[])
 {
   int ix;
   int fullscreen = FALSE;
   int on_root = FALSE;
 
-  int x = UNDEF, y = UNDEF;
-  int depth = -1;
   int w = 400, h = 400;
   char *dpystr = (char *)getenv("DISPLAY");
   char *geom = NULL;
-  int screen;
-  Visual *visual = NULL;
-  XWindowAttributes xgwa;
-  XSetWindowAttributes xswa;
-  unsigned long xswa_mask = 0;
-  XSizeHints hints;
-  GLXContext glx_context = 0;
+  viewopts_t opts;
+  int numheads = 0;
+  headopts_t heads[MAX_HEADS];
 
-  memset(&hints, 0, sizeof(hints));
+  backend = &backend_x11;
 
   progname = argv[0];
 
@@ -125,327 +187,958 @@ int init_view(int *argc, char *argv[])
       !strcmp(argv[ix], "-edge")) {
       addedges = TRUE;
     }
+    else if (!strcmp(argv[ix], "-render-scale") ||
+      !strcmp(argv[ix], "-scale")) {
+      if (ix+1 >= *argc) usage();
+      ix++;
+      if (!strcmp(argv[ix], "auto")) {
+	render_scale_auto = TRUE;
+	render_scale = 1.0;
+      }
+      else {
+	render_scale = atof(argv[ix]);
+	if (render_scale < MIN_RENDER_SCALE || render_scale > 1.0)
+	  usage();
+      }
+    }
+    else if (!strcmp(argv[ix], "-fps")) {
+      double fps;
+      if (ix+1 >= *argc) usage();
+      fps = atof(argv[++ix]);
+      if (fps <= 0.0)
+	usage();
+      frame_ms = 1000.0 / fps;
+    }
+    else if (!strcmp(argv[ix], "-publish")) {
+      if (ix+1 >= *argc) usage();
+      publish_name = argv[++ix];
+    }
+    else if (!strcmp(argv[ix], "-export")) {
+      if (ix+1 >= *argc) usage();
+      export_file = argv[++ix];
+    }
+    else if (!strcmp(argv[ix], "-frames")) {
+      if (ix+1 >= *argc) usage();
+      export_frames = atoi(argv[++ix]);
+      if (export_frames < 0)
+	usage();
+    }
+    else if (!strcmp(argv[ix], "-size")) {
+      char c;
+      if (ix+1 >= *argc) usage();
+      if (2 != sscanf(argv[++ix], "%dx%d%c", &export_width, &export_height,
+	  &c) || export_width <= 0 || export_height <= 0)
+	usage();
+    }
+    else if (!strcmp(argv[ix], "-renderer")) {
+      if (ix+1 >= *argc) usage();
+      ix++;
+      soft = vulkan = FALSE;
+      if (!strcmp(argv[ix], "soft"))
+	soft = TRUE;
+      else if (!strcmp(argv[ix], "vulkan")) {
+#ifdef HAVE_VULKAN
+	soft = vulkan = TRUE;
+#else
+	fprintf(stderr, "%s: built without Vulkan (see the Makefile)\n",
+	  progname);
+	exit(1);
+#endif
+      }
+      else if (!strcmp(argv[ix], "gl"))
+	soft = FALSE;
+      else
+	usage();
+    }
+    else if (!strcmp(argv[ix], "-backend")) {
+      if (ix+1 >= *argc) usage();
+      ix++;
+      if (!strcmp(argv[ix], "x11"))
+	backend = &backend_x11;
+      else if (!strcmp(argv[ix], "egl"))
+	backend = &backend_egl;
+      else
+	usage();
+    }
+    else if (!strcmp(argv[ix], "-head")) {
+      char *cx;
+      if (ix+1 >= *argc || numheads >= MAX_HEADS) usage();
+      ix++;
+      /* DISPLAY@DEGREES, where either part may be left out. */
+      heads[numheads].dpystr = NULL;
+      heads[numheads].spin = 0.0;
+      cx = strrchr(argv[ix], '@');
+      if (cx) {
+	*cx = '\0';
+	heads[numheads].spin = atof(cx+1);
+      }
+      if (argv[ix][0])
+	heads[numheads].dpystr = argv[ix];
+      numheads++;
+    }
+    else if (!strcmp(argv[ix], "-look")) {
+      if (ix+1 >= *argc) usage();
+      move_look = move_find_look(argv[++ix]);
+      if (move_look < 0)
+	usage();
+    }
+    else if (!strcmp(argv[ix], "-loop-cache")) {
+      if (ix+1 >= *argc) usage();
+      loop_cache_mb = atoi(argv[++ix]);
+      if (loop_cache_mb < 0)
+	usage();
+    }
+    else if (!strcmp(argv[ix], "-crossfade")) {
+      if (ix+1 >= *argc) usage();
+      crossfade_ticks = atoi(argv[++ix]);
+      if (crossfade_ticks < 0)
+	usage();
+    }
+    else if (!strcmp(argv[ix], "-control")) {
+      if (ix+1 >= *argc) usage();
+      control_path = argv[++ix];
+    }
+    else if (!strcmp(argv[ix], "-load-state")) {
+      if (ix+1 >= *argc) usage();
+      state_load_file = argv[++ix];
+    }
+    else if (!strcmp(argv[ix], "-save-state")) {
+      if (ix+1 >= *argc) usage();
+      state_save_file = argv[++ix];
+    }
+    else if (!strcmp(argv[ix], "-prelit")) {
+      prelit = TRUE;
+    }
+    else if (!strcmp(argv[ix], "-packed")) {
+      packed = TRUE;
+    }
+    else if (!strcmp(argv[ix], "-depth-test")) {
+      depth_test = TRUE;
+    }
+    else if (!strcmp(argv[ix], "-grid")) {
+      if (ix+1 >= *argc) usage();
+      ix++;
+      if (sscanf(argv[ix], "%dx%d", &grid_cols, &grid_rows) != 2
+	|| grid_cols < 1 || grid_rows < 1)
+	usage();
+    }
+    else if (!strcmp(argv[ix], "-threads")) {
+      if (ix+1 >= *argc) usage();
+      pool_threads = atoi(argv[++ix]);
+      if (pool_threads < 1)
+	usage();
+    }
+    else if (!strcmp(argv[ix], "-budget")) {
+      if (ix+1 >= *argc) usage();
+      gov_budget = atof(argv[++ix]);
+      if (gov_budget <= 0.0)
+	usage();
+    }
+    else if (!strcmp(argv[ix], "-startup-profile")) {
+      startup_profile = TRUE;
+    }
+    else if (!strcmp(argv[ix], "-gpu-profile")) {
+      gpu_profile = TRUE;
+    }
     else {
       usage();
     }
   }
-
-  dpy = XOpenDisplay (dpystr);
-  if (!dpy) {
-    fprintf(stderr, "%s: unable to open display %s\n",
-      progname, dpystr);
-    return FALSE;
+  timer_mark("options");
+
+  if (export_file) {
+    /* We're drawing a movie, not keeping up with a clock, so there's no
+       point in cutting corners. */
+    if (on_root || fullscreen || geom) usage();
+    offscreen = TRUE;
+    w = export_width;
+    h = export_height;
+    render_scale = 1.0;
+    render_scale_auto = FALSE;
+    gov_budget = 0.0;
   }
 
-  screen = DefaultScreen (dpy);
-
-  XA_WM_PROTOCOLS = XInternAtom (dpy, "WM_PROTOCOLS", False);
-  XA_WM_DELETE_WINDOW = XInternAtom (dpy, "WM_DELETE_WINDOW", False);
-
-  if (on_root) {
-    window = RootWindow (dpy, screen);
-    XGetWindowAttributes (dpy, window, &xgwa);
-    visual = xgwa.visual;
-    w = xgwa.width;
-    h = xgwa.height;
+  if (gov_budget > 0.0 && render_scale_auto) {
+    /* The governor picks the render scale itself; two hands on one knob
+       would just fight. */
+    render_scale_auto = FALSE;
   }
-  else {
-    int ww = WidthOfScreen (DefaultScreenOfDisplay (dpy));
-    int hh = HeightOfScreen (DefaultScreenOfDisplay (dpy));
 
-    if (fullscreen) {
-      w = ww;
-      h = hh;
-    }
-    else if (geom) {
-      char c;
-      if      (4 == sscanf (geom, "=%dx%d+%d+%d%c", &w, &h, &x, &y, &c))
-	;
-      else if (4 == sscanf (geom, "=%dx%d-%d+%d%c", &w, &h, &x, &y, &c))
-	x = ww-w-x;
-      else if (4 == sscanf (geom, "=%dx%d+%d-%d%c", &w, &h, &x, &y, &c))
-	y = hh-h-y;
-      else if (4 == sscanf (geom, "=%dx%d-%d-%d%c", &w, &h, &x, &y, &c))
-	x = ww-w-x, y = hh-h-y;
-      else if (2 == sscanf (geom, "=%dx%d%c", &w, &h, &c))
-	;
-      else if (2 == sscanf (geom, "+%d+%d%c", &x, &y, &c))
-	;
-      else if (2 == sscanf (geom, "-%d+%d%c", &x, &y, &c))
-	x = ww-w-x;
-      else if (2 == sscanf (geom, "+%d-%d%c", &x, &y, &c))
-	y = hh-h-y;
-      else if (2 == sscanf (geom, "-%d-%d%c", &x, &y, &c))
-	x = ww-w-x, y = hh-h-y;
-      else {
-	fprintf(stderr, "%s: unparsable geometry: %s\n",
-	  progname, geom);
-	return FALSE;
-      }
+  if (numheads && (soft || offscreen)) {
+    /* Extra heads are GL windows; there's nothing for them to do with a
+       software picture or a movie. */
+    usage();
+  }
 
-      hints.flags = USSize;
-      hints.width = w;
-      hints.height = h;
-      if (x != UNDEF && y != UNDEF) {
-	hints.flags |= USPosition;
-	hints.x = x;
-	hints.y = y;
-      }
-    }
+  if (packed && (soft || numheads || grid_cols)) {
+    /* The packed path draws the one main view. */
+    usage();
+  }
+  if (gpu_profile && soft) {
+    /* There's no GL drawing to time. */
+    usage();
+  }
+  if (grid_cols && (soft || numheads)) {
+    /* The grid is drawn with GL vertex arrays, and in one window only. */
+    usage();
+  }
+  if (grid_cols) {
+    int count = grid_cols * grid_rows * NUM_ELS;
+    grid_faces = (gridvert_t *)malloc(4 * count * sizeof(gridvert_t));
+    grid_edges = (gridvert_t *)malloc(8 * count * sizeof(gridvert_t));
+    if (!grid_faces || !grid_edges)
+      return FALSE;
+  }
 
-    /* Pick a good GL visual */
-    {
-#define R GLX_RED_SIZE
-#define G GLX_GREEN_SIZE
-#define B GLX_BLUE_SIZE
-#define D GLX_DEPTH_SIZE
-#define I GLX_BUFFER_SIZE
-#define DB GLX_DOUBLEBUFFER
-
-      int attrs[][20] = {
-	{ GLX_RGBA, R, 8, G, 8, B, 8, D, 8, DB, 0 }, /* rgb double */
-	{ GLX_RGBA, R, 4, G, 4, B, 4, D, 4, DB, 0 },
-	{ GLX_RGBA, R, 2, G, 2, B, 2, D, 2, DB, 0 },
-	{ GLX_RGBA, R, 8, G, 8, B, 8, D, 8,     0 }, /* rgb single */
-	{ GLX_RGBA, R, 4, G, 4, B, 4, D, 4,     0 },
-	{ GLX_RGBA, R, 2, G, 2, B, 2, D, 2,     0 },
-	{ I, 8,                       D, 8, DB, 0 }, /* cmap double */
-	{ I, 4,                       D, 4, DB, 0 },
-	{ I, 8,                       D, 8,     0 }, /* cmap single */
-	{ I, 4,                       D, 4,     0 },
-	{ GLX_RGBA, R, 1, G, 1, B, 1, D, 1,     0 }  /* monochrome */
-      };
-      int i;
-
-      for (i = 0; i < sizeof(attrs)/sizeof(*attrs); i++) {
-	XVisualInfo *vi = glXChooseVisual (dpy, screen, attrs[i]);
-	if (vi) {
-	  visual = vi->visual;
-	  XFree (vi);
-	  break;
-	}
-      }
-      if (!visual) {
-	fprintf (stderr, "%s: unable to find a GL visual\n", progname);
-	return FALSE;
-      }
+  if (soft) {
+    /* There's no framebuffer to scale; the governor can still use its
+       other knobs. */
+    render_scale = 1.0;
+    render_scale_auto = FALSE;
+    if (!init_pool())
+      return FALSE;
+    if (vulkan && !vk_init())
+      return FALSE;
+    if (offscreen) {
+      /* Nothing to show, so we don't need a backend at all. */
+      backend = NULL;
+      win_reshape(w, h);
+      return TRUE;
     }
+  }
 
-    if (x == UNDEF) x = 0;
-    if (y == UNDEF) y = 0;
+  opts.dpystr = dpystr;
+  opts.geom = geom;
+  opts.fullscreen = fullscreen;
+  opts.on_root = on_root;
+  opts.offscreen = offscreen;
+  opts.soft = soft;
+  opts.width = w;
+  opts.height = h;
+  opts.argc = *argc;
+  opts.argv = argv;
+  opts.numheads = numheads;
+  opts.heads = heads;
+  if (!backend->init(&opts))
+    return FALSE;
+  w = opts.width;
+  h = opts.height;
 
-    xswa_mask = (CWEventMask | CWColormap |
-      CWBackPixel | CWBackingPixel | CWBorderPixel );
-    xswa.colormap = XCreateColormap (dpy, RootWindow (dpy, screen),
-      visual, AllocNone);
-    xswa.background_pixel = BlackPixel (dpy, screen);
-    xswa.backing_pixel = xswa.background_pixel;
-    xswa.border_pixel = xswa.background_pixel;
-    xswa.event_mask = (KeyPressMask | ButtonPressMask | StructureNotifyMask);
+  setup_window();
+  if (offscreen && !have_fbo) {
+    fprintf(stderr, "%s: exporting needs framebuffer objects\n", progname);
+    return FALSE;
+  }
+  win_reshape(w, h);
+  timer_mark("GL setup");
 
-    depth = visual_depth (dpy, screen, visual);
-    if (depth < 0)
-      return FALSE;
+  return TRUE;
+}
 
-    window = XCreateWindow(dpy, RootWindow(dpy, screen),
-      x, y, w, h, 0,
-      depth,
-      InputOutput, visual,
-      xswa_mask, &xswa);
+static void setup_window()
+{
+  const char *version;
+  int major = 0;
 
-    {
-      XTextProperty tp;
-      XStringListToTextProperty (&progclass, 1, &tp);
-      XSetWMProperties (dpy, window, &tp, &tp, argv, *argc, &hints, 0, 0);
-    }
+  if (soft)
+    return;
 
-    XChangeProperty (dpy, window, XA_WM_PROTOCOLS, XA_ATOM, 32,
-      PropModeReplace,
-      (unsigned char *)&XA_WM_DELETE_WINDOW, 1);
+  view_setup_gl();
 
-    XMapRaised (dpy, window);
-    XSync (dpy, False);
+  if (packed && !packed_init()) {
+    fprintf(stderr, "%s: no GL instancing; ignoring --packed\n", progname);
+    packed = FALSE;
   }
 
+  gpuprof_init();
+
+  /* Offscreen rendering needs framebuffer objects and blitting, which are
+     core in GL 3.0, and have the same entry points in ARB_framebuffer_object
+     before that. (The older EXT extensions name theirs differently, so
+     they don't count.) */
+  version = (const char *)glGetString(GL_VERSION);
+  if (version)
+    sscanf(version, "%d", &major);
+  have_fbo = (major >= 3 || gl_has_extension("GL_ARB_framebuffer_object"));
+  if (!have_fbo && (render_scale < 1.0 || render_scale_auto)) {
+    fprintf(stderr, "%s: no framebuffer objects; ignoring --render-scale\n",
+      progname);
+    render_scale = 1.0;
+    render_scale_auto = FALSE;
+  }
+}
 
-  /* Now hook up to GLX */
-  {
-    XVisualInfo vi_in, *vi_out;
-    int out_count;
+/* The GL state we draw with. Every head's context needs this once. */
+void view_setup_gl(void)
+{
+  glEnable(GL_CULL_FACE);
+  glEnable(GL_DEPTH_TEST);
 
-    vi_in.screen = screen;
-    vi_in.visualid = XVisualIDFromVisual (visual);
-    vi_out = XGetVisualInfo (dpy, VisualScreenMask|VisualIDMask,
-      &vi_in, &out_count);
-    if (!vi_out)
-      return FALSE;
+  if (!prelit) {
+    glEnable(GL_LIGHTING);
+    glEnable(GL_LIGHT0);
+    glEnable(GL_NORMALIZE);
+  }
+}
 
-    glx_context = glXCreateContext (dpy, vi_out, 0, GL_TRUE);
-    XFree(vi_out);
+/* Set the current context's viewport and projection for a drawing area of
+   the given size. */
+void view_project(int width, int height)
+{
+  GLfloat h = (GLfloat) height / (GLfloat) width;
 
-    if (!glx_context) {
-      fprintf(stderr, "%s: couldn't create GL context for root window.\n",
-	progname);
-      return FALSE;
-    }
+  glViewport(0, 0, (GLint) width, (GLint) height);
+  glMatrixMode(GL_PROJECTION);
+  glLoadIdentity();
+  glFrustum(-1.0, 1.0, -h, h, 5.0, 60.0);
+  glMatrixMode(GL_MODELVIEW);
+  glLoadIdentity();
+  glTranslatef(0.0, 0.0, -40.0);
+}
 
-    glXMakeCurrent (dpy, window, glx_context);
-  }
+/* Check whether the GL implementation advertises an extension. We have to
+   match whole words, since some extension names are prefixes of others. */
+int gl_has_extension(char *name)
+{
+  const char *ext = (const char *)glGetString(GL_EXTENSIONS);
+  int len = strlen(name);
 
-  setup_window();
-  win_reshape(w, h);
+  if (!ext)
+    return FALSE;
 
-  return TRUE;
+  while ((ext = strstr(ext, name)) != NULL) {
+    if (ext[len] == ' ' || ext[len] == '\0')
+      return TRUE;
+    ext += len;
+  }
+  return FALSE;
 }
 
-static void setup_window()
+/* Decide whether a list of polygons can be drawn without the depth test,
+   back to front. Every square lies flat at its own height and faces up,
+   so if the eye is above them all, drawing them from the lowest to the
+   highest gets every overlap right. (Spinning about the Z axis doesn't
+   change that.) The heights are usually in order already -- in most
+   looks, alti is a Linear of the element number -- so we only check.
+
+   Returns 1 to draw in list order, -1 to draw in reverse, or 0 if the
+   heights aren't strictly monotonic or the eye is among them, in which
+   case the depth buffer has to sort things out. */
+int view_painter_order(elem_t *list, int stride)
 {
-  glEnable(GL_CULL_FACE);
-  glEnable(GL_LIGHTING);
-  glEnable(GL_LIGHT0);
-  glEnable(GL_DEPTH_TEST);
-
-  glEnable(GL_NORMALIZE);
+  GLfloat eyez, top;
+  int ix, last, up = TRUE, down = TRUE;
+
+  if (depth_test)
+    return 0;
+
+  last = ((NUM_ELS - 1) / stride) * stride;
+  for (ix=stride; ix<=last; ix+=stride) {
+    if (list[ix].pos[2] <= list[ix-stride].pos[2])
+      up = FALSE;
+    if (list[ix].pos[2] >= list[ix-stride].pos[2])
+      down = FALSE;
+  }
+  if (!up && !down)
+    return 0;
+
+  /* The eye is 40 units back from the origin (see view_project()), which
+     the rotations tip over towards +Z. */
+  eyez = (40.0 / view_scale) * cos(view_rotx * M_PI / 180.0)
+    * cos(view_roty * M_PI / 180.0);
+  top = (up ? list[last].pos[2] : list[0].pos[2]);
+  if (eyez <= top)
+    return 0;
+
+  return (up ? 1 : -1);
 }
 
-/* callback: draw everything */
-void win_draw(void)
+/* Draw the current elist into the current GL context, turned spin degrees
+   further about the Z axis than usual. This only reads shared state, so
+   each head's thread can call it for its own context. */
+void view_draw_scene(GLfloat spin)
 {
-  int ix;
+  int ix, order, pass;
 
   static GLfloat white[] = { 1.0, 1.0, 1.0, 1.0 };
   static GLfloat grey[] =  { 0.6, 0.6, 0.6, 1.0 };
+  GLfloat light = 1.0;
+  GLfloat edgecol[3];
+  int edged = ((addedges && edges_allowed) || wireframe);
+
+  if (prelit) {
+    /* The light doesn't depend on the aspect ratio, or on spin. */
+    GLfloat mvp[16];
+    transform_aspect(1.0, mvp, &light);
+    for (ix=0; ix<3; ix++) {
+      edgecol[ix] = (wireframe ? white : grey)[ix] * light;
+      if (edgecol[ix] > 1.0)
+	edgecol[ix] = 1.0;
+    }
+  }
 
-  glDrawBuffer(GL_BACK);
-
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  order = view_painter_order(elist, draw_stride);
+  if (order) {
+    glDisable(GL_DEPTH_TEST);
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
+  else {
+    glEnable(GL_DEPTH_TEST);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  }
 
   glPushMatrix();
   glScalef(view_scale, view_scale, view_scale);
   glRotatef(view_rotx, 1.0, 0.0, 0.0);
   glRotatef(view_roty, 0.0, 1.0, 0.0);
-  glRotatef(view_rotz, 0.0, 0.0, 1.0);
+  glRotatef(view_rotz + spin, 0.0, 0.0, 1.0);
 
   glShadeModel(GL_FLAT);
 
-  for (ix=0; ix<NUM_ELS; ix++) {
-    elem_t *el = &elist[ix];
+  /* Faces and edges are drawn square by square, so they're timed as one
+     pass when there are both. */
+  pass = (wireframe ? GPU_EDGES : (edged ? GPU_BOTH : GPU_FACES));
+  gpuprof_begin(pass);
+  scene_pass(order, !wireframe, edged, light, edgecol);
+  gpuprof_end(pass);
 
-    glNormal3f(0.0, 0.0, 1.0);
+  glPopMatrix();
+}
 
-    if (addedges || wireframe) {
+/* Draw the faces, or the edges, or both, of every draw_stride'th
+   element, in the given order. With both, they go square by square, so
+   that squares at the same height hide each other's edges the way they
+   hide each other's faces. */
+static void scene_pass(int order, int faces, int edges, GLfloat light,
+  GLfloat *edgecol)
+{
+  int jx, last;
 
-      glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE,
-	(wireframe ? white : grey));
-      glBegin(GL_LINE_LOOP);
+  last = ((NUM_ELS - 1) / draw_stride) * draw_stride;
+  for (jx=0; jx<=last; jx+=draw_stride) {
+    elem_t *el = &elist[(order < 0) ? last - jx : jx];
 
-      glVertex3f(el->pos[0] - el->vervec[0], el->pos[1] - el->vervec[1],
-	el->pos[2]);
-      glVertex3f(el->pos[0] + el->vervec[1], el->pos[1] - el->vervec[0],
-	el->pos[2]);
-      glVertex3f(el->pos[0] + el->vervec[0], el->pos[1] + el->vervec[1],
-	el->pos[2]);
-      glVertex3f(el->pos[0] - el->vervec[1], el->pos[1] + el->vervec[0],
-	el->pos[2]);
+    if (!prelit)
+      glNormal3f(0.0, 0.0, 1.0);
 
-      glEnd();
+    if (order) {
+      /* Back to front: each square's edges go on top of its face. */
+      if (faces)
+	scene_face(el, light);
+      if (edges)
+	scene_edge(el, edgecol);
+    }
+    else {
+      /* Edges first, so that they win the depth test against their own
+	 faces. */
+      if (edges)
+	scene_edge(el, edgecol);
+      if (faces)
+	scene_face(el, light);
     }
+  }
+}
 
-    if (!wireframe) {
+static void scene_edge(elem_t *el, GLfloat *edgecol)
+{
+  static GLfloat white[] = { 1.0, 1.0, 1.0, 1.0 };
+  static GLfloat grey[] =  { 0.6, 0.6, 0.6, 1.0 };
 
-      glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE,
-	el->col);
-      glBegin(GL_QUADS);
+  if (prelit)
+    glColor3fv(edgecol);
+  else
+    glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE,
+      (wireframe ? white : grey));
+  glBegin(GL_LINE_LOOP);
+
+  glVertex3f(el->pos[0] - el->vervec[0], el->pos[1] - el->vervec[1],
+    el->pos[2]);
+  glVertex3f(el->pos[0] + el->vervec[1], el->pos[1] - el->vervec[0],
+    el->pos[2]);
+  glVertex3f(el->pos[0] + el->vervec[0], el->pos[1] + el->vervec[1],
+    el->pos[2]);
+  glVertex3f(el->pos[0] - el->vervec[1], el->pos[1] + el->vervec[0],
+    el->pos[2]);
+
+  glEnd();
+}
 
-      glVertex3f(el->pos[0] - el->vervec[0], el->pos[1] - el->vervec[1],
-	el->pos[2]);
-      glVertex3f(el->pos[0] + el->vervec[1], el->pos[1] - el->vervec[0],
-	el->pos[2]);
-      glVertex3f(el->pos[0] + el->vervec[0], el->pos[1] + el->vervec[1],
-	el->pos[2]);
-      glVertex3f(el->pos[0] - el->vervec[1], el->pos[1] + el->vervec[0],
-	el->pos[2]);
+static void scene_face(elem_t *el, GLfloat light)
+{
+  if (prelit) {
+    GLfloat r = el->col[0] * light, g = el->col[1] * light,
+      b = el->col[2] * light;
+    glColor3f((r > 1.0 ? 1.0 : r), (g > 1.0 ? 1.0 : g),
+      (b > 1.0 ? 1.0 : b));
+  }
+  else {
+    glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE,
+      el->col);
+  }
+  glBegin(GL_QUADS);
+
+  glVertex3f(el->pos[0] - el->vervec[0], el->pos[1] - el->vervec[1],
+    el->pos[2]);
+  glVertex3f(el->pos[0] + el->vervec[1], el->pos[1] - el->vervec[0],
+    el->pos[2]);
+  glVertex3f(el->pos[0] + el->vervec[0], el->pos[1] + el->vervec[1],
+    el->pos[2]);
+  glVertex3f(el->pos[0] - el->vervec[1], el->pos[1] + el->vervec[0],
+    el->pos[2]);
+
+  glEnd();
+}
 
-      glEnd();
-    }
+/* callback: draw everything */
+void win_draw(void)
+{
+  double start = timer_msec();
+  double submitted;
+
+  if (soft) {
+    if (!vulkan)
+      soft_draw(elist, draw_stride, (addedges && edges_allowed), wireframe);
+    else if (!vk_draw(elist, draw_stride, (addedges && edges_allowed),
+	wireframe))
+      return; /* nothing new to show yet */
+    show_soft();
+    return;
   }
 
-  glPopMatrix();
+  if (fbo)
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  else
+    glDrawBuffer(GL_BACK);
+
+  /* The other heads draw the same elist, in parallel with us. */
+  backend->heads_begin();
+  if (grid_cols) {
+    draw_grid();
+  }
+  else if (packed) {
+    packed_draw(elist, draw_stride, (addedges && edges_allowed), wireframe);
+  }
+  else
+    view_draw_scene(0.0);
+  backend->heads_end();
+
+  if (offscreen) {
+    /* No glFinish() here; the whole point of export_readback() is to not
+       wait for the drawing to finish. */
+    submitted = timer_msec();
+    export_readback();
+    gpuprof_frame(submitted - start, timer_msec() - start);
+    return;
+  }
+
+  if (fbo) {
+    /* Stretch the offscreen image onto the window. */
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glDrawBuffer(GL_BACK);
+    glBlitFramebuffer(0, 0, fbo_width, fbo_height,
+      0, 0, win_width, win_height,
+      GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
 
+  submitted = timer_msec();
   glFinish();
-  glXSwapBuffers(dpy, window);
+  gpuprof_frame(submitted - start, timer_msec() - start);
 
-  handle_events();
+  if (render_scale_auto)
+    autoscale_frame(timer_msec() - start);
 
+  backend->present();
 }
 
-/* callback: new window size or exposure */
-static void win_reshape(int width, int height)
+/* Send the soft (or Vulkan) frame to the export file or the window. */
+static void show_soft()
 {
-  GLfloat h = (GLfloat) height / (GLfloat) width;
+  if (offscreen) {
+    int stride;
+    unsigned char *pixels = soft_pixels(&stride);
+    export_pixels(pixels, stride, TRUE);
+  }
+  else {
+    backend->present();
+  }
+}
+
+/* Show whatever frames are still in the works. Only the Vulkan renderer
+   keeps any; the export loop calls this before it closes the file. */
+void win_flush(void)
+{
+  if (!vulkan)
+    return;
+  while (vk_finish())
+    show_soft();
+}
+
+/* Create, resize, or throw away the offscreen framebuffer, so that it
+   matches the window size times render_scale. */
+static void resize_target(void)
+{
+  int width, height;
+  GLfloat scale = render_scale;
+
+  if (scale > render_scale_limit)
+    scale = render_scale_limit;
+
+  if (!have_fbo || (scale >= 1.0 && !offscreen)) {
+    if (fbo) {
+      glDeleteFramebuffers(1, &fbo);
+      glDeleteRenderbuffers(1, &fbo_color);
+      glDeleteRenderbuffers(1, &fbo_depth);
+      fbo = fbo_color = fbo_depth = 0;
+    }
+    fbo_width = win_width;
+    fbo_height = win_height;
+    return;
+  }
+
+  width = (int)(win_width * scale + 0.5);
+  height = (int)(win_height * scale + 0.5);
+  if (width < 1) width = 1;
+  if (height < 1) height = 1;
+
+  if (fbo && width == fbo_width && height == fbo_height)
+    return;
+
+  if (!fbo) {
+    glGenFramebuffers(1, &fbo);
+    glGenRenderbuffers(1, &fbo_color);
+    glGenRenderbuffers(1, &fbo_depth);
+  }
+  fbo_width = width;
+  fbo_height = height;
+
+  glBindRenderbuffer(GL_RENDERBUFFER, fbo_color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, fbo_depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+    GL_RENDERBUFFER, fbo_color);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+    GL_RENDERBUFFER, fbo_depth);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    /* Give up on scaling and draw straight into the window. */
+    fprintf(stderr, "%s: offscreen framebuffer incomplete; not scaling\n",
+      progname);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    have_fbo = FALSE;
+    render_scale = 1.0;
+    render_scale_auto = FALSE;
+    resize_target();
+    return;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+/* In --render-scale auto mode, this is called with the time each frame took
+   to draw. We keep a running average, and every so often nudge the scale
+   down if we're over budget, or back up if there's plenty of slack. */
+static void autoscale_frame(double ms)
+{
+  static double avg = 0.0;
+  static int frames = 0;
+  GLfloat newscale = render_scale;
+
+  avg = (frames ? (avg * 0.9 + ms * 0.1) : ms);
+  frames++;
+  if (frames < AUTOSCALE_PERIOD)
+    return;
+  frames = 0;
+
+  if (avg > AUTOSCALE_TARGET)
+    newscale = render_scale * 0.85;
+  else if (avg < AUTOSCALE_TARGET * 0.5)
+    newscale = render_scale * 1.1;
+
+  if (newscale < MIN_RENDER_SCALE)
+    newscale = MIN_RENDER_SCALE;
+  if (newscale > 1.0)
+    newscale = 1.0;
+
+  if (newscale != render_scale) {
+    render_scale = newscale;
+    win_reshape(win_width, win_height);
+  }
+}
+
+/* Work out, on the CPU, the same transformation that win_reshape() and
+   win_draw() give GL: the combined projection and modelview matrix
+   (column-major, the way GL stores them). Also the brightness that GL's
+   lighting gives a polygon facing +Z: the default light shines down the
+   eye's -Z axis, so that's the global ambient (0.2) plus the Z component
+   of the transformed normal. */
+void view_transform(GLfloat *mvp, GLfloat *light)
+{
+  transform_aspect((GLfloat) fbo_height / (GLfloat) fbo_width, mvp, light);
+}
+
+/* The same, for a drawing area whose height is aspect times its width. */
+static void transform_aspect(GLfloat aspect, GLfloat *mvp, GLfloat *light)
+{
+  GLfloat mv[16], proj[16], rot[16], tmp[16];
+  GLfloat len;
+  int ix;
+
+  /* The modelview matrix: translate, scale, then rotate about X, Y, Z. */
+  memset(mv, 0, sizeof(mv));
+  mv[0] = mv[5] = mv[10] = view_scale;
+  mv[14] = -40.0;
+  mv[15] = 1.0;
+  matrix_rotate(rot, view_rotx, 1.0, 0.0, 0.0);
+  matrix_mult(tmp, mv, rot);
+  matrix_rotate(rot, view_roty, 0.0, 1.0, 0.0);
+  matrix_mult(mv, tmp, rot);
+  matrix_rotate(rot, view_rotz, 0.0, 0.0, 1.0);
+  matrix_mult(tmp, mv, rot);
+  for (ix=0; ix<16; ix++)
+    mv[ix] = tmp[ix];
+
+  /* The projection is glFrustum(-1, 1, -aspect, aspect, 5, 60). */
+  memset(proj, 0, sizeof(proj));
+  proj[0] = 5.0;
+  proj[5] = 5.0 / aspect;
+  proj[10] = -(60.0 + 5.0) / (60.0 - 5.0);
+  proj[11] = -1.0;
+  proj[14] = -(2.0 * 60.0 * 5.0) / (60.0 - 5.0);
+  matrix_mult(mvp, proj, mv);
+
+  len = sqrt(mv[8]*mv[8] + mv[9]*mv[9] + mv[10]*mv[10]);
+  *light = 0.2;
+  if (len > 0.0 && mv[10] > 0.0)
+    *light += mv[10] / len;
+}
+
+/* Draw the grid. Hundreds of tiles would mean hundreds of trips through
+   view_draw_scene()'s glBegin/glEnd loop, so instead the tiles are
+   transformed to clip space on the CPU (in parallel, on the thread pool),
+   each squeezed into its own cell of the window, and GL gets one vertex
+   array of edges and one of faces. Lighting is the same sum soft.c does.
+   We don't clip to the cells, but the usual framing leaves a wide margin
+   around each universe, so nothing strays into its neighbours. */
+static void draw_grid()
+{
+  int count;
+  GLfloat aspect = ((GLfloat) fbo_height / grid_rows)
+    / ((GLfloat) fbo_width / grid_cols);
+
+  grid_kept = (NUM_ELS - 1) / draw_stride + 1;
+  count = grid_cols * grid_rows * grid_kept;
+  transform_aspect(aspect, grid_mvp, &grid_light);
+  grid_edged = ((addedges && edges_allowed) || wireframe);
+  pool_run(grid_cols * grid_rows, grid_build_one, NULL);
+
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  glViewport(0, 0, (GLint) width, (GLint) height);
   glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
   glLoadIdentity();
-  glFrustum(-1.0, 1.0, -h, h, 5.0, 60.0);
   glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
   glLoadIdentity();
-  glTranslatef(0.0, 0.0, -40.0);
+  glDisable(GL_LIGHTING);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+
+  /* Edges first, so that they win the depth test against their own
+     faces, as they do in view_draw_scene(). */
+  if (grid_edged) {
+    gpuprof_begin(GPU_EDGES);
+    glVertexPointer(4, GL_FLOAT, sizeof(gridvert_t), grid_edges[0].pos);
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(gridvert_t),
+      grid_edges[0].col);
+    glDrawArrays(GL_LINES, 0, 8 * count);
+    gpuprof_end(GPU_EDGES);
+  }
+  if (!wireframe) {
+    gpuprof_begin(GPU_FACES);
+    glVertexPointer(4, GL_FLOAT, sizeof(gridvert_t), grid_faces[0].pos);
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(gridvert_t),
+      grid_faces[0].col);
+    glDrawArrays(GL_QUADS, 0, 4 * count);
+    gpuprof_end(GPU_FACES);
+  }
+
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  if (!prelit)
+    glEnable(GL_LIGHTING);
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
 }
 
+static void grid_set_color(gridvert_t *vert, GLfloat *col)
+{
+  int jx;
+
+  for (jx=0; jx<3; jx++) {
+    GLfloat f = col[jx] * grid_light;
+    vert->col[jx] = (f >= 1.0) ? 255 : (f <= 0.0) ? 0 : (GLubyte)(f * 255.0);
+  }
+  vert->col[3] = 255;
+}
 
-static void handle_events(void)
+/* Fill in the vertices for one tile (pool_run() callback). Elements that
+   the stride skips are left out altogether. Every tile keeps the same
+   number, grid_kept, so each still has a fixed place in the arrays, and
+   the tiles run on in one block that draw_grid() draws. */
+static void grid_build_one(int tile, void *rock)
 {
-  while (XPending(dpy)) {
-    XEvent evstruct;
-    XEvent *event = &evstruct;
-    XNextEvent (dpy, event);
-    switch (event->xany.type) {
-    case ConfigureNotify:
-      {
-	XWindowAttributes xgwa;
-	XGetWindowAttributes (dpy, window, &xgwa);
-	win_reshape (xgwa.width, xgwa.height);
-	break;
-      }
-    case KeyPress:
-      {
-	KeySym keysym;
-	char c = 0;
-	XLookupString (&event->xkey, &c, 1, &keysym, 0);
-	if (c == 'q' ||
-	  c == 'Q' ||
-	  c == 3 ||	/* ^C */
-	  c == 27)	/* ESC */
-	  exit (0);
-	else if (! (keysym >= XK_Shift_L && keysym <= XK_Hyper_R))
-	  XBell (dpy, 0);  /* beep for non-chord keys */
-      }
-      break;
-    case ButtonPress:
-      XBell (dpy, 0);
-      break;
-    case ClientMessage:
-      {
-	if (event->xclient.message_type != XA_WM_PROTOCOLS) {
-	  char *s = XGetAtomName(dpy, event->xclient.message_type);
-	  if (!s) s = "(null)";
-	  fprintf (stderr, "%s: unknown ClientMessage %s received!\n",
-	    progname, s);
-	}
-	else if (event->xclient.data.l[0] != XA_WM_DELETE_WINDOW) {
-	  char *s1 = XGetAtomName(dpy, event->xclient.message_type);
-	  char *s2 = XGetAtomName(dpy, event->xclient.data.l[0]);
-	  if (!s1) s1 = "(null)";
-	  if (!s2) s2 = "(null)";
-	  fprintf (stderr,"%s: unknown ClientMessage %s[%s] received!\n",
-	    progname, s1, s2);
-	}
-	else {
-	  exit (0);
-	}
+  static GLfloat white[] = { 1.0, 1.0, 1.0, 1.0 };
+  static GLfloat grey[] =  { 0.6, 0.6, 0.6, 1.0 };
+  int col = tile % grid_cols, row = tile / grid_cols;
+  GLfloat sx = 1.0 / grid_cols, sy = 1.0 / grid_rows;
+  GLfloat ox = -1.0 + (2 * col + 1) * sx;
+  GLfloat oy = 1.0 - (2 * row + 1) * sy;
+  GLfloat m[16];
+  elem_t *list = &grid_elist[tile * NUM_ELS];
+  gridvert_t *face = &grid_faces[tile * grid_kept * 4];
+  gridvert_t *edge = &grid_edges[tile * grid_kept * 8];
+  int ix, jx;
+
+  /* The cell's matrix: the view's, then scale and shift into the cell.
+     (Column-major, so m[4*c + r].) */
+  for (jx=0; jx<4; jx++) {
+    m[4*jx + 0] = grid_mvp[4*jx + 0] * sx + grid_mvp[4*jx + 3] * ox;
+    m[4*jx + 1] = grid_mvp[4*jx + 1] * sy + grid_mvp[4*jx + 3] * oy;
+    m[4*jx + 2] = grid_mvp[4*jx + 2];
+    m[4*jx + 3] = grid_mvp[4*jx + 3];
+  }
+
+  for (ix=0; ix<NUM_ELS; ix+=draw_stride, face += 4, edge += 8) {
+    elem_t *el = &list[ix];
+    GLfloat corner[4][2];
+
+    corner[0][0] = el->pos[0] - el->vervec[0];
+    corner[0][1] = el->pos[1] - el->vervec[1];
+    corner[1][0] = el->pos[0] + el->vervec[1];
+    corner[1][1] = el->pos[1] - el->vervec[0];
+    corner[2][0] = el->pos[0] + el->vervec[0];
+    corner[2][1] = el->pos[1] + el->vervec[1];
+    corner[3][0] = el->pos[0] - el->vervec[1];
+    corner[3][1] = el->pos[1] + el->vervec[0];
+
+    for (jx=0; jx<4; jx++) {
+      GLfloat x = corner[jx][0], y = corner[jx][1], z = el->pos[2];
+      GLfloat *pos = face[jx].pos;
+      pos[0] = m[0]*x + m[4]*y + m[8]*z + m[12];
+      pos[1] = m[1]*x + m[5]*y + m[9]*z + m[13];
+      pos[2] = m[2]*x + m[6]*y + m[10]*z + m[14];
+      pos[3] = m[3]*x + m[7]*y + m[11]*z + m[15];
+      grid_set_color(&face[jx], el->col);
+    }
+
+    if (grid_edged) {
+      for (jx=0; jx<4; jx++) {
+	edge[2*jx] = face[jx];
+	edge[2*jx+1] = face[(jx+1) % 4];
       }
-      break;
+      for (jx=0; jx<8; jx++)
+	grid_set_color(&edge[jx], (wireframe ? white : grey));
     }
   }
 }
+
+/* res = a * b, for column-major 4x4 matrices. res must not be a or b. */
+static void matrix_mult(GLfloat *res, GLfloat *a, GLfloat *b)
+{
+  int row, col, ix;
+
+  for (col=0; col<4; col++) {
+    for (row=0; row<4; row++) {
+      GLfloat sum = 0.0;
+      for (ix=0; ix<4; ix++)
+	sum += a[ix*4 + row] * b[col*4 + ix];
+      res[col*4 + row] = sum;
+    }
+  }
+}
+
+/* The matrix that glRotatef(angle, x, y, z) would make, for a unit axis. */
+static void matrix_rotate(GLfloat *res, GLfloat angle, GLfloat x, GLfloat y,
+  GLfloat z)
+{
+  GLfloat rad = angle * M_PI / 180.0;
+  GLfloat c = cos(rad), s = sin(rad), t = 1.0 - c;
+
+  res[0] = t*x*x + c;   res[4] = t*x*y - s*z; res[8] = t*x*z + s*y;
+  res[1] = t*x*y + s*z; res[5] = t*y*y + c;   res[9] = t*y*z - s*x;
+  res[2] = t*x*z - s*y; res[6] = t*y*z + s*x; res[10] = t*z*z + c;
+  res[3] = res[7] = res[11] = 0.0;
+  res[12] = res[13] = res[14] = 0.0;
+  res[15] = 1.0;
+}
+
+/* Knobs for the quality governor. */
+
+void view_set_edges(int flag)
+{
+  edges_allowed = flag;
+}
+
+void view_set_stride(int stride)
+{
+  draw_stride = (stride < 1) ? 1 : stride;
+}
+
+void view_set_scale_limit(double limit)
+{
+  if (limit == render_scale_limit || soft)
+    return;
+  render_scale_limit = limit;
+  if (win_width && win_height)
+    win_reshape(win_width, win_height);
+}
+
+/* callback: new window size or exposure */
+void win_reshape(int width, int height)
+{
+  win_width = width;
+  win_height = height;
+
+  if (soft) {
+    fbo_width = width;
+    fbo_height = height;
+    if (backend)
+      backend->resize(width, height);
+    else
+      soft_resize(width, height, NULL, 0);
+    if (vulkan && !vk_resize(width, height))
+      exit(1);
+    return;
+  }
+
+  if (backend)
+    backend->resize(width, height);
+
+  resize_target();
+  view_project(fbo_width, fbo_height);
+}
+
+
+/* The main loop's view of the backend. */
+
+int view_fd(void)
+{
+  return backend ? backend->fd() : -1;
+}
+
+int view_visible(void)
+{
+  return backend ? backend->visible() : TRUE;
+}
+
+void view_events(void)
+{
+  if (backend)
+    backend->events();
+}
@@ -5,5 +5,24 @@
    See main.c, the Copying document, or the above URL for details.
 */
 
+extern char *progname;
+extern double frame_ms;
+
 extern int init_view(int *argc, char *argv[]);
 extern void win_draw(void);
+extern void win_flush(void);
+extern void win_reshape(int width, int height);
+extern int view_fd(void);
+extern int view_visible(void);
+extern void view_events(void);
+extern void view_transform(GLfloat *mvp, GLfloat *light);
+extern int gl_has_extension(char *name);
+extern void view_setup_gl(void);
+extern void view_project(int width, int height);
+extern void view_draw_scene(GLfloat spin);
+struct elem_struct; /* see move.h */
+extern int view_painter_order(struct elem_struct *list, int stride);
+
+extern void view_set_edges(int flag);
+extern void view_set_stride(int stride);
+extern void view_set_scale_limit(double limit);
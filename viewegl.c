@@ -0,0 +1,181 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+/* The EGL backend: a GL context with no window and no X server. We ask
+   Mesa for its "surfaceless" platform, which gives us a context with
+   nothing to draw on but framebuffer objects -- which is all view.c needs
+   when it's exporting. If that isn't available, we try the first EGL
+   device (a render node, say). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+
+#include "general.h"
+#include "view.h"
+#include "backend.h"
+#include "timer.h"
+
+static EGLDisplay egl_dpy = EGL_NO_DISPLAY;
+static EGLContext egl_context = EGL_NO_CONTEXT;
+
+static int egl_init(viewopts_t *opts);
+static void egl_resize(int width, int height);
+static void egl_present(void);
+static int egl_fd(void);
+static int egl_visible(void);
+static void egl_events(void);
+static void egl_heads(void);
+
+backend_t backend_egl = {
+  "egl",
+  egl_init,
+  egl_resize,
+  egl_present,
+  egl_fd,
+  egl_visible,
+  egl_events,
+  egl_heads,
+  egl_heads
+};
+
+static int has_extension(const char *list, char *name)
+{
+  int len = strlen(name);
+
+  if (!list)
+    return FALSE;
+
+  while ((list = strstr(list, name)) != NULL) {
+    if (list[len] == ' ' || list[len] == '\0')
+      return TRUE;
+    list += len;
+  }
+  return FALSE;
+}
+
+/* Find a display with nothing attached. */
+static EGLDisplay open_display(void)
+{
+  const char *clientext = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getplatformdisplay;
+
+  getplatformdisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+    eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if (!getplatformdisplay)
+    return EGL_NO_DISPLAY;
+
+  if (has_extension(clientext, "EGL_MESA_platform_surfaceless")) {
+    EGLDisplay edpy = getplatformdisplay(EGL_PLATFORM_SURFACELESS_MESA,
+      EGL_DEFAULT_DISPLAY, NULL);
+    if (edpy != EGL_NO_DISPLAY)
+      return edpy;
+  }
+
+  if (has_extension(clientext, "EGL_EXT_platform_device")) {
+    PFNEGLQUERYDEVICESEXTPROC querydevices;
+    EGLDeviceEXT device;
+    EGLint count = 0;
+
+    querydevices = (PFNEGLQUERYDEVICESEXTPROC)
+      eglGetProcAddress("eglQueryDevicesEXT");
+    if (querydevices && querydevices(1, &device, &count) && count > 0)
+      return getplatformdisplay(EGL_PLATFORM_DEVICE_EXT, device, NULL);
+  }
+
+  return EGL_NO_DISPLAY;
+}
+
+static int egl_init(viewopts_t *opts)
+{
+  EGLint major, minor, count;
+  EGLConfig config = NULL;
+  static EGLint attrs[] = {
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_SURFACE_TYPE, 0,
+    EGL_NONE
+  };
+
+  if (!opts->offscreen || opts->soft) {
+    fprintf(stderr, "%s: the egl backend only works with --export\n",
+      progname);
+    return FALSE;
+  }
+
+  egl_dpy = open_display();
+  if (egl_dpy == EGL_NO_DISPLAY || !eglInitialize(egl_dpy, &major, &minor)) {
+    fprintf(stderr, "%s: unable to open a headless EGL display\n",
+      progname);
+    return FALSE;
+  }
+  timer_mark("open display");
+
+  if (!has_extension(eglQueryString(egl_dpy, EGL_EXTENSIONS),
+      "EGL_KHR_surfaceless_context")) {
+    fprintf(stderr, "%s: EGL can't make a context without a surface\n",
+      progname);
+    return FALSE;
+  }
+
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    fprintf(stderr, "%s: EGL doesn't do desktop GL\n", progname);
+    return FALSE;
+  }
+
+  /* We never draw to an EGL surface, so any config will do -- or none,
+     if the driver allows it. */
+  if (!eglChooseConfig(egl_dpy, attrs, &config, 1, &count) || count < 1)
+    config = NULL;
+  timer_mark("choose config");
+
+  egl_context = eglCreateContext(egl_dpy, config, EGL_NO_CONTEXT, NULL);
+  if (egl_context == EGL_NO_CONTEXT) {
+    fprintf(stderr, "%s: couldn't create an EGL context\n", progname);
+    return FALSE;
+  }
+  if (!eglMakeCurrent(egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE,
+      egl_context)) {
+    fprintf(stderr, "%s: couldn't make the EGL context current\n",
+      progname);
+    return FALSE;
+  }
+  timer_mark("create context");
+
+  return TRUE;
+}
+
+/* There's no window, so the rest of these have nothing to do. */
+
+static void egl_resize(int width, int height)
+{
+}
+
+static void egl_present()
+{
+}
+
+static int egl_fd()
+{
+  return -1;
+}
+
+static int egl_visible()
+{
+  return TRUE;
+}
+
+static void egl_events()
+{
+}
+
+static void egl_heads()
+{
+}
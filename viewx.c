@@ -0,0 +1,803 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+/* The X11 backend: a window (or the root window) with a GLX context.
+   With the software renderer, it's a window with an XImage instead. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xatom.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <GL/gl.h>
+#include <GL/glx.h>
+
+#include "general.h"
+#include "osc.h"
+#include "view.h"
+#include "vroot.h"
+#include "backend.h"
+#include "timer.h"
+
+#include "move.h"
+#include "soft.h"
+
+static char *progclass = "StonerView";
+
+static Display *dpy;
+static Window window;
+static int mapped = TRUE, obscured = FALSE;
+static int cur_width = 0, cur_height = 0;
+
+static Atom XA_WM_PROTOCOLS, XA_WM_DELETE_WINDOW;
+
+/* With the software renderer, soft.c draws into an XImage (shared with the
+   X server if possible), which we put up on the window each frame.
+   soft_visual is NULL when we're using GL. */
+static Visual *soft_visual = NULL;
+static int soft_depth = 0;
+static XImage *soft_image = NULL;
+static XShmSegmentInfo soft_shminfo;
+static int soft_useshm = FALSE;
+static GC soft_gc = 0;
+
+/* Each extra head has its own X connection, window, and GL context, and
+   a thread which draws into them. The threads all wait for win_draw()
+   to say that a new elist is ready, and win_draw() waits for them all to
+   finish reading it before it goes on. */
+typedef struct head_struct {
+  GLfloat spin;
+  Display *dpy;
+  Window window;
+  GLXContext context;
+  Atom wm_protocols, wm_delete_window;
+  int width, height;
+  pthread_t thread;
+} head_t;
+
+static head_t heads[MAX_HEADS];
+static int numheads = 0;
+static pthread_mutex_t heads_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t heads_go = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t heads_idle = PTHREAD_COND_INITIALIZER;
+static unsigned long heads_frame = 0;
+static int heads_busy = 0;
+
+static int open_head(viewopts_t *opts, headopts_t *hopts, head_t *head);
+static void *head_thread(void *rock);
+static void head_quit(void);
+
+static int x_init(viewopts_t *opts);
+static void x_resize(int width, int height);
+static void x_present(void);
+static int x_fd(void);
+static int x_visible(void);
+static void x_events(void);
+static void x_heads_begin(void);
+static void x_heads_end(void);
+
+backend_t backend_x11 = {
+  "x11",
+  x_init,
+  x_resize,
+  x_present,
+  x_fd,
+  x_visible,
+  x_events,
+  x_heads_begin,
+  x_heads_end
+};
+
+/* What we need to know to make a GL window: the visual and depth, and the
+   FBConfig they came from. (For the root window we have to take the
+   visual we're given, and there's no FBConfig.) */
+typedef struct glvis_struct {
+  Visual *visual;
+  int depth;
+  GLXFBConfig config;
+} glvis_t;
+
+/* Where we remember which FBConfig we chose last time, so that we can ask
+   for it by ID instead of making the server sort through all of them. */
+static char *config_cache_path(void)
+{
+  static char path[1024];
+  char *dir = getenv("XDG_CACHE_HOME");
+  char *home = getenv("HOME");
+
+  if (dir && dir[0])
+    snprintf(path, sizeof(path), "%s/stonerview-fbconfig", dir);
+  else if (home && home[0])
+    snprintf(path, sizeof(path), "%s/.cache/stonerview-fbconfig", home);
+  else
+    return NULL;
+  return path;
+}
+
+/* The cache is keyed by the things we can learn about the server without
+   asking it anything. */
+static void config_cache_key(Display *dpy, int screen, char *buf, int len)
+{
+  snprintf(buf, len, "%s %d %s %d", DisplayString (dpy), screen,
+    ServerVendor (dpy), VendorRelease (dpy));
+}
+
+static int config_cache_load(Display *dpy, int screen)
+{
+  char key[512], line[1024];
+  char *path = config_cache_path();
+  FILE *fl;
+  int id = 0;
+
+  if (!path || !(fl = fopen(path, "r")))
+    return 0;
+  config_cache_key(dpy, screen, key, sizeof(key));
+  while (fgets(line, sizeof(line), fl)) {
+    char *cx = strrchr(line, ' ');
+    if (cx && cx - line == strlen(key) && !strncmp(line, key, cx - line)) {
+      id = atoi(cx+1);
+      break;
+    }
+  }
+  fclose(fl);
+  return id;
+}
+
+/* We only remember one display, which is the common case. */
+static void config_cache_save(Display *dpy, int screen, int id)
+{
+  char key[512];
+  char *path = config_cache_path();
+  FILE *fl;
+
+  if (!path || !(fl = fopen(path, "w")))
+    return;
+  config_cache_key(dpy, screen, key, sizeof(key));
+  fprintf(fl, "%s %d\n", key, id);
+  fclose(fl);
+}
+
+/* Pick a good GL config: RGB with a depth buffer, double-buffered if
+   possible. The server sorts the candidates best first, so one query
+   does it; if we've been here before, we ask for last time's choice by
+   ID. */
+static int choose_config(Display *dpy, int screen, glvis_t *gv)
+{
+  int want[] = {
+    GLX_X_RENDERABLE, True,
+    GLX_DRAWABLE_TYPE, GLX_WINDOW_BIT,
+    GLX_RENDER_TYPE, GLX_RGBA_BIT,
+    GLX_RED_SIZE, 1, GLX_GREEN_SIZE, 1, GLX_BLUE_SIZE, 1,
+    GLX_DEPTH_SIZE, 1,
+    GLX_DOUBLEBUFFER, True,
+    None
+  };
+  int byid[] = { GLX_FBCONFIG_ID, 0, None };
+  GLXFBConfig *configs = NULL;
+  XVisualInfo *vi = NULL;
+  int count = 0, ix, id;
+
+  byid[1] = config_cache_load(dpy, screen);
+  if (byid[1])
+    configs = glXChooseFBConfig (dpy, screen, byid, &count);
+  if (!configs || count < 1) {
+    if (configs)
+      XFree(configs);
+    configs = glXChooseFBConfig (dpy, screen, want, &count);
+    if (!configs || count < 1) {
+      /* Single-buffered will have to do. */
+      want[sizeof(want)/sizeof(*want) - 2] = False;
+      if (configs)
+	XFree(configs);
+      configs = glXChooseFBConfig (dpy, screen, want, &count);
+    }
+  }
+
+  for (ix = 0; configs && ix < count; ix++) {
+    vi = glXGetVisualFromFBConfig (dpy, configs[ix]);
+    if (vi)
+      break;
+  }
+  if (!vi) {
+    if (configs)
+      XFree(configs);
+    fprintf (stderr, "%s: unable to find a GL visual\n", progname);
+    return FALSE;
+  }
+
+  gv->visual = vi->visual;
+  gv->depth = vi->depth;
+  gv->config = configs[ix];
+  XFree(vi);
+  XFree(configs);
+
+  if (glXGetFBConfigAttrib (dpy, gv->config, GLX_FBCONFIG_ID, &id) == Success
+    && id != byid[1])
+    config_cache_save(dpy, screen, id);
+  return TRUE;
+}
+
+/* Make a top-level window, with the WM properties we want. */
+static Window make_window(Display *dpy, int screen, Visual *visual,
+  int depth, int x, int y, int w, int h, XSizeHints *hints,
+  Atom *protocols, viewopts_t *opts)
+{
+  XSetWindowAttributes xswa;
+  unsigned long xswa_mask = 0;
+  Window win;
+
+  xswa_mask = (CWEventMask | CWColormap |
+    CWBackPixel | CWBackingPixel | CWBorderPixel );
+  xswa.colormap = XCreateColormap (dpy, RootWindow (dpy, screen),
+    visual, AllocNone);
+  xswa.background_pixel = BlackPixel (dpy, screen);
+  xswa.backing_pixel = xswa.background_pixel;
+  xswa.border_pixel = xswa.background_pixel;
+  xswa.event_mask = (KeyPressMask | ButtonPressMask | StructureNotifyMask
+    | VisibilityChangeMask);
+
+  win = XCreateWindow(dpy, RootWindow(dpy, screen),
+    x, y, w, h, 0,
+    depth,
+    InputOutput, visual,
+    xswa_mask, &xswa);
+
+  {
+    XTextProperty tp;
+    XStringListToTextProperty (&progclass, 1, &tp);
+    XSetWMProperties (dpy, win, &tp, &tp, opts->argv, opts->argc,
+      hints, 0, 0);
+  }
+
+  /* protocols[0] is WM_PROTOCOLS, protocols[1] is WM_DELETE_WINDOW. */
+  XChangeProperty (dpy, win, protocols[0], XA_ATOM, 32,
+    PropModeReplace,
+    (unsigned char *)&protocols[1], 1);
+
+  /* No XSync here; nothing we do next needs the window to exist yet, and
+     the first swap or event wait flushes the queue anyway. */
+  if (!opts->offscreen)
+    XMapRaised (dpy, win);
+
+  return win;
+}
+
+/* A GL context for the chosen config -- or, for the root window, for
+   whatever visual it has. */
+static GLXContext make_context(Display *dpy, int screen, glvis_t *gv)
+{
+  GLXContext context;
+
+  if (gv->config) {
+    context = glXCreateNewContext (dpy, gv->config, GLX_RGBA_TYPE, 0,
+      GL_TRUE);
+  }
+  else {
+    XVisualInfo vi_in, *vi_out;
+    int out_count;
+
+    vi_in.screen = screen;
+    vi_in.visualid = XVisualIDFromVisual (gv->visual);
+    vi_out = XGetVisualInfo (dpy, VisualScreenMask|VisualIDMask,
+      &vi_in, &out_count);
+    if (!vi_out)
+      return 0;
+    context = glXCreateContext (dpy, vi_out, 0, GL_TRUE);
+    XFree(vi_out);
+  }
+
+  if (!context)
+    fprintf(stderr, "%s: couldn't create GL context for root window.\n",
+      progname);
+  return context;
+}
+
+/* Both the atoms we need, in one round trip. */
+static void get_atoms(Display *dpy, Atom *protocols)
+{
+  static char *names[2] = { "WM_PROTOCOLS", "WM_DELETE_WINDOW" };
+  XInternAtoms (dpy, names, 2, False, protocols);
+}
+
+#define UNDEF (-65536)
+
+static int x_init(viewopts_t *opts)
+{
+  int x = UNDEF, y = UNDEF;
+  int w = opts->width, h = opts->height;
+  char *geom = opts->geom;
+  int screen;
+  glvis_t gv;
+  Atom protocols[2];
+  XWindowAttributes xgwa;
+  XSizeHints hints;
+  GLXContext glx_context = 0;
+
+  memset(&hints, 0, sizeof(hints));
+  memset(&gv, 0, sizeof(gv));
+
+  /* The heads' threads all call Xlib and GLX, each on its own
+     connection. Older Xlibs (and some GLX drivers) still want to be told
+     before the first connection is opened. */
+  if (opts->numheads && !XInitThreads()) {
+    fprintf(stderr, "%s: Xlib can't do threads; can't open --head\n",
+      progname);
+    return FALSE;
+  }
+
+  dpy = XOpenDisplay (opts->dpystr);
+  if (!dpy) {
+    fprintf(stderr, "%s: unable to open display %s\n",
+      progname, (opts->dpystr ? opts->dpystr : "(default)"));
+    return FALSE;
+  }
+  timer_mark("open display");
+
+  screen = DefaultScreen (dpy);
+
+  get_atoms(dpy, protocols);
+  XA_WM_PROTOCOLS = protocols[0];
+  XA_WM_DELETE_WINDOW = protocols[1];
+
+  if (opts->on_root) {
+    window = RootWindow (dpy, screen);
+    XGetWindowAttributes (dpy, window, &xgwa);
+    gv.visual = xgwa.visual;
+    gv.depth = xgwa.depth;
+    w = xgwa.width;
+    h = xgwa.height;
+  }
+  else {
+    int ww = WidthOfScreen (DefaultScreenOfDisplay (dpy));
+    int hh = HeightOfScreen (DefaultScreenOfDisplay (dpy));
+
+    if (opts->fullscreen) {
+      w = ww;
+      h = hh;
+    }
+    else if (geom) {
+      char c;
+      if      (4 == sscanf (geom, "=%dx%d+%d+%d%c", &w, &h, &x, &y, &c))
+	;
+      else if (4 == sscanf (geom, "=%dx%d-%d+%d%c", &w, &h, &x, &y, &c))
+	x = ww-w-x;
+      else if (4 == sscanf (geom, "=%dx%d+%d-%d%c", &w, &h, &x, &y, &c))
+	y = hh-h-y;
+      else if (4 == sscanf (geom, "=%dx%d-%d-%d%c", &w, &h, &x, &y, &c))
+	x = ww-w-x, y = hh-h-y;
+      else if (2 == sscanf (geom, "=%dx%d%c", &w, &h, &c))
+	;
+      else if (2 == sscanf (geom, "+%d+%d%c", &x, &y, &c))
+	;
+      else if (2 == sscanf (geom, "-%d+%d%c", &x, &y, &c))
+	x = ww-w-x;
+      else if (2 == sscanf (geom, "+%d-%d%c", &x, &y, &c))
+	y = hh-h-y;
+      else if (2 == sscanf (geom, "-%d-%d%c", &x, &y, &c))
+	x = ww-w-x, y = hh-h-y;
+      else {
+	fprintf(stderr, "%s: unparsable geometry: %s\n",
+	  progname, geom);
+	return FALSE;
+      }
+
+      hints.flags = USSize;
+      hints.width = w;
+      hints.height = h;
+      if (x != UNDEF && y != UNDEF) {
+	hints.flags |= USPosition;
+	hints.x = x;
+	hints.y = y;
+      }
+    }
+
+    if (opts->soft) {
+      gv.visual = DefaultVisual (dpy, screen);
+      gv.depth = DefaultDepth (dpy, screen);
+    }
+    else {
+      if (!choose_config (dpy, screen, &gv))
+	return FALSE;
+    }
+    timer_mark("choose config");
+
+    if (x == UNDEF) x = 0;
+    if (y == UNDEF) y = 0;
+
+    window = make_window (dpy, screen, gv.visual, gv.depth, x, y, w, h,
+      &hints, protocols, opts);
+    if (!window)
+      return FALSE;
+    timer_mark("create window");
+  }
+
+
+  cur_width = w;
+  cur_height = h;
+  opts->width = w;
+  opts->height = h;
+
+  if (opts->soft) {
+    soft_visual = gv.visual;
+    soft_depth = gv.depth;
+    soft_gc = XCreateGC (dpy, window, 0, NULL);
+    soft_useshm = XShmQueryExtension (dpy);
+    return TRUE;
+  }
+
+  /* Now hook up to GLX */
+  glx_context = make_context (dpy, screen, &gv);
+  if (!glx_context)
+    return FALSE;
+  glXMakeCurrent (dpy, window, glx_context);
+  timer_mark("create context");
+
+  for (numheads = 0; numheads < opts->numheads; numheads++) {
+    if (!open_head(opts, &opts->heads[numheads], &heads[numheads]))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* With the software renderer, set up (or resize) the XImage that it
+   draws into. With GL there's nothing to do. */
+static void x_resize(int width, int height)
+{
+  if (!soft_visual)
+    return;
+
+  if (soft_image) {
+    if (soft_useshm) {
+      XShmDetach(dpy, &soft_shminfo);
+      XDestroyImage(soft_image);
+      shmdt(soft_shminfo.shmaddr);
+    }
+    else {
+      XDestroyImage(soft_image);
+    }
+    soft_image = NULL;
+  }
+
+  if (soft_useshm) {
+    soft_image = XShmCreateImage(dpy, soft_visual, soft_depth, ZPixmap,
+      NULL, &soft_shminfo, width, height);
+    if (soft_image) {
+      soft_shminfo.shmid = shmget(IPC_PRIVATE,
+	soft_image->bytes_per_line * height, IPC_CREAT | 0600);
+      soft_shminfo.shmaddr = (soft_shminfo.shmid < 0) ? (char *)-1
+	: (char *)shmat(soft_shminfo.shmid, NULL, 0);
+      if (soft_shminfo.shmaddr == (char *)-1) {
+	if (soft_shminfo.shmid >= 0)
+	  shmctl(soft_shminfo.shmid, IPC_RMID, NULL);
+	XDestroyImage(soft_image);
+	soft_image = NULL;
+      }
+      else {
+	soft_image->data = soft_shminfo.shmaddr;
+	soft_shminfo.readOnly = False;
+	XShmAttach(dpy, &soft_shminfo);
+	XSync(dpy, False);
+	/* Mark it for deletion now; it goes away when we both let go. */
+	shmctl(soft_shminfo.shmid, IPC_RMID, NULL);
+      }
+    }
+    if (!soft_image)
+      soft_useshm = FALSE;
+  }
+
+  if (!soft_image) {
+    char *data = (char *)malloc((size_t)width * height * 4);
+    if (data) {
+      soft_image = XCreateImage(dpy, soft_visual, soft_depth, ZPixmap, 0,
+	data, width, height, 32, 0);
+      if (!soft_image)
+	free(data);
+    }
+  }
+
+  if (!soft_image) {
+    fprintf(stderr, "%s: couldn't create an image to draw into\n",
+      progname);
+    exit(1);
+  }
+  if (soft_image->bits_per_pixel != 32 || soft_image->red_mask != 0xFF0000
+    || soft_image->green_mask != 0xFF00 || soft_image->blue_mask != 0xFF
+    || soft_image->byte_order != LSBFirst) {
+    fprintf(stderr, "%s: the software renderer needs a 24-bit TrueColor "
+      "display\n", progname);
+    exit(1);
+  }
+
+  soft_resize(width, height, (unsigned char *)soft_image->data,
+    soft_image->bytes_per_line);
+}
+
+/* Show the frame: swap buffers, or put the software renderer's picture up
+   on the window. */
+static void x_present()
+{
+  if (!soft_visual) {
+    glXSwapBuffers(dpy, window);
+    return;
+  }
+  if (!soft_image)
+    return;
+
+  if (soft_useshm)
+    XShmPutImage(dpy, window, soft_gc, soft_image, 0, 0, 0, 0,
+      cur_width, cur_height, False);
+  else
+    XPutImage(dpy, window, soft_gc, soft_image, 0, 0, 0, 0,
+      cur_width, cur_height);
+  /* Wait for the server to take it, so we don't start scribbling on the
+     next frame while it's still reading this one. */
+  XSync(dpy, False);
+}
+
+/* The file descriptor of the X connection, for the main loop to wait on. */
+static int x_fd(void)
+{
+  return ConnectionNumber(dpy);
+}
+
+/* Whether any of the window can be seen. (In --root mode, we don't get
+   told, so we assume it can.) */
+static int x_visible(void)
+{
+  return (mapped && !obscured);
+}
+
+/* Deal with any X events that have come in. This also flushes our output
+   to the server, which is what we want before the main loop goes to
+   sleep. */
+static void x_events(void)
+{
+  while (XPending(dpy)) {
+    XEvent evstruct;
+    XEvent *event = &evstruct;
+    XNextEvent (dpy, event);
+    switch (event->xany.type) {
+    case ConfigureNotify:
+      if (event->xconfigure.width != cur_width ||
+	event->xconfigure.height != cur_height) {
+	cur_width = event->xconfigure.width;
+	cur_height = event->xconfigure.height;
+	win_reshape (cur_width, cur_height);
+      }
+      break;
+    case MapNotify:
+      mapped = TRUE;
+      break;
+    case UnmapNotify:
+      mapped = FALSE;
+      break;
+    case VisibilityNotify:
+      obscured = (event->xvisibility.state == VisibilityFullyObscured);
+      break;
+    case KeyPress:
+      {
+	KeySym keysym;
+	char c = 0;
+	XLookupString (&event->xkey, &c, 1, &keysym, 0);
+	if (c == 'q' ||
+	  c == 'Q' ||
+	  c == 3 ||	/* ^C */
+	  c == 27)	/* ESC */
+	  exit (0);
+	else if (! (keysym >= XK_Shift_L && keysym <= XK_Hyper_R))
+	  XBell (dpy, 0);  /* beep for non-chord keys */
+      }
+      break;
+    case ButtonPress:
+      XBell (dpy, 0);
+      break;
+    case ClientMessage:
+      {
+	if (event->xclient.message_type != XA_WM_PROTOCOLS) {
+	  char *s = XGetAtomName(dpy, event->xclient.message_type);
+	  if (!s) s = "(null)";
+	  fprintf (stderr, "%s: unknown ClientMessage %s received!\n",
+	    progname, s);
+	}
+	else if (event->xclient.data.l[0] != XA_WM_DELETE_WINDOW) {
+	  char *s1 = XGetAtomName(dpy, event->xclient.message_type);
+	  char *s2 = XGetAtomName(dpy, event->xclient.data.l[0]);
+	  if (!s1) s1 = "(null)";
+	  if (!s2) s2 = "(null)";
+	  fprintf (stderr,"%s: unknown ClientMessage %s[%s] received!\n",
+	    progname, s1, s2);
+	}
+	else {
+	  exit (0);
+	}
+      }
+      break;
+    }
+  }
+}
+
+/* Open an extra head: its own connection, window, and context. The head
+   is as big as the main window, or fills its screen if the main window
+   does. Its thread starts drawing at the next frame. */
+static int open_head(viewopts_t *opts, headopts_t *hopts, head_t *head)
+{
+  char *dpystr = (hopts->dpystr ? hopts->dpystr : opts->dpystr);
+  int screen;
+  glvis_t gv;
+  XWindowAttributes xgwa;
+  XSizeHints hints;
+  Atom protocols[2];
+
+  memset(&hints, 0, sizeof(hints));
+  memset(&gv, 0, sizeof(gv));
+
+  head->spin = hopts->spin;
+  head->dpy = XOpenDisplay (dpystr);
+  if (!head->dpy) {
+    fprintf(stderr, "%s: unable to open display %s\n",
+      progname, (dpystr ? dpystr : "(default)"));
+    return FALSE;
+  }
+  screen = DefaultScreen (head->dpy);
+
+  get_atoms(head->dpy, protocols);
+  head->wm_protocols = protocols[0];
+  head->wm_delete_window = protocols[1];
+
+  if (opts->on_root) {
+    head->window = RootWindow (head->dpy, screen);
+    XGetWindowAttributes (head->dpy, head->window, &xgwa);
+    gv.visual = xgwa.visual;
+    gv.depth = xgwa.depth;
+    head->width = xgwa.width;
+    head->height = xgwa.height;
+  }
+  else {
+    if (opts->fullscreen) {
+      head->width = WidthOfScreen (DefaultScreenOfDisplay (head->dpy));
+      head->height = HeightOfScreen (DefaultScreenOfDisplay (head->dpy));
+    }
+    else {
+      head->width = opts->width;
+      head->height = opts->height;
+    }
+    if (!choose_config (head->dpy, screen, &gv))
+      return FALSE;
+    head->window = make_window (head->dpy, screen, gv.visual, gv.depth,
+      0, 0, head->width, head->height, &hints, protocols, opts);
+    if (!head->window)
+      return FALSE;
+  }
+
+  head->context = make_context (head->dpy, screen, &gv);
+  if (!head->context)
+    return FALSE;
+
+  if (pthread_create(&head->thread, NULL, head_thread, head)) {
+    fprintf(stderr, "%s: couldn't start a thread for a head\n", progname);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* A head can't just exit(): the atexit() handlers save the state, and
+   the main thread may be in the middle of stepping it. So we send the
+   process a SIGTERM, which only the main thread takes (see head_thread),
+   and let it leave the way it would for any other SIGTERM. */
+static void head_quit()
+{
+  kill(getpid(), SIGTERM);
+}
+
+/* Deal with a head's X events. Only its own thread touches its
+   connection. */
+static void head_events(head_t *head)
+{
+  while (XPending(head->dpy)) {
+    XEvent event;
+    XNextEvent (head->dpy, &event);
+    switch (event.xany.type) {
+    case ConfigureNotify:
+      if (event.xconfigure.width != head->width ||
+	event.xconfigure.height != head->height) {
+	head->width = event.xconfigure.width;
+	head->height = event.xconfigure.height;
+	view_project (head->width, head->height);
+      }
+      break;
+    case KeyPress:
+      {
+	KeySym keysym;
+	char c = 0;
+	XLookupString (&event.xkey, &c, 1, &keysym, 0);
+	if (c == 'q' ||
+	  c == 'Q' ||
+	  c == 3 ||	/* ^C */
+	  c == 27)	/* ESC */
+	  head_quit();
+      }
+      break;
+    case ClientMessage:
+      if (event.xclient.message_type == head->wm_protocols &&
+	event.xclient.data.l[0] == head->wm_delete_window)
+	head_quit();
+      break;
+    }
+  }
+}
+
+static void *head_thread(void *rock)
+{
+  head_t *head = rock;
+  unsigned long seen = 0;
+  sigset_t mask;
+
+  /* Leave the quit and swap signals to the main thread. */
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  sigaddset(&mask, SIGHUP);
+  pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+  glXMakeCurrent (head->dpy, head->window, head->context);
+  view_setup_gl();
+  view_project(head->width, head->height);
+
+  while (TRUE) {
+    pthread_mutex_lock(&heads_lock);
+    while (heads_frame == seen)
+      pthread_cond_wait(&heads_go, &heads_lock);
+    seen = heads_frame;
+    pthread_mutex_unlock(&heads_lock);
+
+    head_events(head);
+    glDrawBuffer(GL_BACK);
+    view_draw_scene(head->spin);
+
+    /* GL has copied everything it needs out of elist by now, so the main
+       thread can get on with the next frame while we swap. */
+    pthread_mutex_lock(&heads_lock);
+    if (--heads_busy == 0)
+      pthread_cond_signal(&heads_idle);
+    pthread_mutex_unlock(&heads_lock);
+
+    glXSwapBuffers (head->dpy, head->window);
+  }
+
+  return NULL;
+}
+
+static void x_heads_begin()
+{
+  if (!numheads)
+    return;
+  pthread_mutex_lock(&heads_lock);
+  heads_frame++;
+  heads_busy = numheads;
+  pthread_cond_broadcast(&heads_go);
+  pthread_mutex_unlock(&heads_lock);
+}
+
+static void x_heads_end()
+{
+  if (!numheads)
+    return;
+  pthread_mutex_lock(&heads_lock);
+  while (heads_busy)
+    pthread_cond_wait(&heads_idle, &heads_lock);
+  pthread_mutex_unlock(&heads_lock);
+}
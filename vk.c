@@ -0,0 +1,866 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+/* The Vulkan renderer (--renderer vulkan). Like packed.c, it sends each
+   polygon to the card as one small instance record and lets a vertex
+   shader make a square of it. Unlike GL immediate mode, there's no
+   driver checking its state on every vertex: a frame is one command
+   buffer, recorded and submitted in one go.
+
+   We draw offscreen and copy the result back into soft.c's pixel buffer,
+   after which the backend shows it exactly as it would a --renderer soft
+   frame. So there's no window-system plumbing here at all, and it runs
+   wherever there's a Vulkan driver -- including Mesa's lavapipe, which
+   needs no GPU. (Set VK_ICD_FILENAMES to lavapipe's ICD file if you have
+   more than one driver and want that one.)
+
+   Each of the FRAMES_IN_FLIGHT slots has its own instance buffer (mapped
+   for good, so filling it is just stores), its own images, command
+   buffer, readback buffer, and fence. We fill and submit one slot while
+   the card works on the others, and wait on a slot's fence only when we
+   want its pixels. The price is that what we show is a frame behind what
+   we've submitted. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <GL/gl.h>
+#include <vulkan/vulkan.h>
+
+#include "general.h"
+#include "osc.h"
+#include "move.h"
+#include "view.h"
+#include "soft.h"
+#include "vk.h"
+
+/* SPIR-V, made from vk.vert and vk.frag by glslangValidator. */
+#include "vk_vert.h"
+#include "vk_frag.h"
+
+#define FRAMES_IN_FLIGHT (2)
+
+/* The same pixel layout soft.c draws. */
+#define COLOR_FORMAT (VK_FORMAT_B8G8R8A8_UNORM)
+/* Every Vulkan driver can use this one for depth. */
+#define DEPTH_FORMAT (VK_FORMAT_D16_UNORM)
+
+typedef struct vkinst_struct {
+  float pos[3];
+  GLubyte col[4];
+} vkinst_t;
+
+/* The push constants; see vk.vert. */
+typedef struct vkconsts_struct {
+  GLfloat mvp[16];
+  GLfloat vervec[4];
+  GLfloat flatcol[4];
+} vkconsts_t;
+
+typedef struct vkimage_struct {
+  VkImage image;
+  VkDeviceMemory memory;
+  VkImageView view;
+} vkimage_t;
+
+typedef struct vkbuffer_struct {
+  VkBuffer buffer;
+  VkDeviceMemory memory;
+  void *data; /* mapped for as long as the buffer lives */
+} vkbuffer_t;
+
+typedef struct slot_struct {
+  vkbuffer_t instances;
+  vkbuffer_t readback;
+  vkimage_t color, depth;
+  VkFramebuffer framebuffer;
+  VkCommandBuffer cmd;
+  VkFence fence;
+} slot_t;
+
+static VkInstance instance = VK_NULL_HANDLE;
+static VkPhysicalDevice physdev = VK_NULL_HANDLE;
+static VkPhysicalDeviceMemoryProperties memprops;
+static VkDevice device = VK_NULL_HANDLE;
+static uint32_t queue_family = 0;
+static VkQueue queue = VK_NULL_HANDLE;
+static VkCommandPool cmdpool = VK_NULL_HANDLE;
+static VkRenderPass renderpass = VK_NULL_HANDLE;
+static VkPipelineLayout layout = VK_NULL_HANDLE;
+static VkPipeline face_pipe = VK_NULL_HANDLE, edge_pipe = VK_NULL_HANDLE;
+
+static slot_t slots[FRAMES_IN_FLIGHT];
+static int width = 0, height = 0;
+
+/* Frames submitted but not yet shown. The oldest is in slots[head]. */
+static int head = 0, pending = 0;
+
+static int make_device(void);
+static int make_renderpass(void);
+static int make_pipelines(void);
+static int make_pipeline(VkShaderModule vert, VkShaderModule frag,
+  VkPrimitiveTopology topology, VkCullModeFlags cull, VkPipeline *pipe);
+static VkShaderModule make_shader(const uint32_t *code, size_t size);
+static int make_buffer(vkbuffer_t *buf, VkDeviceSize size,
+  VkBufferUsageFlags usage, VkMemoryPropertyFlags want);
+static void free_buffer(vkbuffer_t *buf);
+static int make_image(vkimage_t *img, VkFormat format,
+  VkImageUsageFlags usage, VkImageAspectFlags aspect);
+static void free_image(vkimage_t *img);
+static int find_memory(uint32_t typebits, VkMemoryPropertyFlags want,
+  VkMemoryPropertyFlags need);
+static GLubyte pack_channel(GLfloat val);
+
+int vk_init()
+{
+  VkCommandPoolCreateInfo cpci;
+  VkCommandBufferAllocateInfo cbai;
+  VkFenceCreateInfo fci;
+  int ix;
+
+  if (!make_device() || !make_renderpass() || !make_pipelines())
+    return FALSE;
+
+  memset(&cpci, 0, sizeof(cpci));
+  cpci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  cpci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  cpci.queueFamilyIndex = queue_family;
+  if (vkCreateCommandPool(device, &cpci, NULL, &cmdpool) != VK_SUCCESS) {
+    fprintf(stderr, "%s: couldn't create a Vulkan command pool\n",
+      progname);
+    return FALSE;
+  }
+
+  memset(&fci, 0, sizeof(fci));
+  fci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+  for (ix=0; ix<FRAMES_IN_FLIGHT; ix++) {
+    slot_t *slot = &slots[ix];
+
+    memset(&cbai, 0, sizeof(cbai));
+    cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cbai.commandPool = cmdpool;
+    cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cbai.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(device, &cbai, &slot->cmd) != VK_SUCCESS
+      || vkCreateFence(device, &fci, NULL, &slot->fence) != VK_SUCCESS) {
+      fprintf(stderr, "%s: couldn't set up Vulkan frames\n", progname);
+      return FALSE;
+    }
+
+    if (!make_buffer(&slot->instances, NUM_ELS * sizeof(vkinst_t),
+	VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, 0))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Take the first device that can draw. */
+static int make_device()
+{
+  VkApplicationInfo app;
+  VkInstanceCreateInfo ici;
+  VkDeviceQueueCreateInfo qci;
+  VkDeviceCreateInfo dci;
+  VkPhysicalDevice *devs;
+  uint32_t count = 0, ix, jx;
+  float priority = 1.0;
+
+  memset(&app, 0, sizeof(app));
+  app.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  app.pApplicationName = "stonerview";
+  app.apiVersion = VK_API_VERSION_1_0;
+
+  memset(&ici, 0, sizeof(ici));
+  ici.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  ici.pApplicationInfo = &app;
+
+  if (vkCreateInstance(&ici, NULL, &instance) != VK_SUCCESS) {
+    fprintf(stderr, "%s: unable to start up Vulkan\n", progname);
+    return FALSE;
+  }
+
+  vkEnumeratePhysicalDevices(instance, &count, NULL);
+  devs = (VkPhysicalDevice *)malloc((count ? count : 1)
+    * sizeof(VkPhysicalDevice));
+  if (!devs)
+    return FALSE;
+  vkEnumeratePhysicalDevices(instance, &count, devs);
+
+  for (ix=0; ix<count && !physdev; ix++) {
+    VkQueueFamilyProperties *fams;
+    uint32_t numfams = 0;
+
+    vkGetPhysicalDeviceQueueFamilyProperties(devs[ix], &numfams, NULL);
+    fams = (VkQueueFamilyProperties *)malloc((numfams ? numfams : 1)
+      * sizeof(VkQueueFamilyProperties));
+    if (!fams)
+      break;
+    vkGetPhysicalDeviceQueueFamilyProperties(devs[ix], &numfams, fams);
+    for (jx=0; jx<numfams; jx++) {
+      if (fams[jx].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+	physdev = devs[ix];
+	queue_family = jx;
+	break;
+      }
+    }
+    free(fams);
+  }
+  free(devs);
+
+  if (!physdev) {
+    fprintf(stderr, "%s: no Vulkan device that can draw\n", progname);
+    return FALSE;
+  }
+
+  vkGetPhysicalDeviceMemoryProperties(physdev, &memprops);
+
+  memset(&qci, 0, sizeof(qci));
+  qci.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+  qci.queueFamilyIndex = queue_family;
+  qci.queueCount = 1;
+  qci.pQueuePriorities = &priority;
+
+  memset(&dci, 0, sizeof(dci));
+  dci.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  dci.queueCreateInfoCount = 1;
+  dci.pQueueCreateInfos = &qci;
+
+  if (vkCreateDevice(physdev, &dci, NULL, &device) != VK_SUCCESS) {
+    fprintf(stderr, "%s: couldn't open the Vulkan device\n", progname);
+    return FALSE;
+  }
+  vkGetDeviceQueue(device, queue_family, 0, &queue);
+
+  return TRUE;
+}
+
+/* One pass: clear, draw, and leave the color image ready to be copied
+   out. */
+static int make_renderpass()
+{
+  VkAttachmentDescription att[2];
+  VkAttachmentReference colref, depthref;
+  VkSubpassDescription sub;
+  VkSubpassDependency dep;
+  VkRenderPassCreateInfo rpci;
+
+  memset(att, 0, sizeof(att));
+  att[0].format = COLOR_FORMAT;
+  att[0].samples = VK_SAMPLE_COUNT_1_BIT;
+  att[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  att[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  att[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  att[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  att[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  att[0].finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  att[1].format = DEPTH_FORMAT;
+  att[1].samples = VK_SAMPLE_COUNT_1_BIT;
+  att[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  att[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  att[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  att[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  att[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  att[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  colref.attachment = 0;
+  colref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  depthref.attachment = 1;
+  depthref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  memset(&sub, 0, sizeof(sub));
+  sub.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  sub.colorAttachmentCount = 1;
+  sub.pColorAttachments = &colref;
+  sub.pDepthStencilAttachment = &depthref;
+
+  /* The copy waits for the drawing. (Each slot has its own images, and we
+     wait on a slot's fence before using it again, so nothing needs to
+     wait for a previous frame.) */
+  memset(&dep, 0, sizeof(dep));
+  dep.srcSubpass = 0;
+  dep.dstSubpass = VK_SUBPASS_EXTERNAL;
+  dep.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dep.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  dep.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dep.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+  memset(&rpci, 0, sizeof(rpci));
+  rpci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  rpci.attachmentCount = 2;
+  rpci.pAttachments = att;
+  rpci.subpassCount = 1;
+  rpci.pSubpasses = &sub;
+  rpci.dependencyCount = 1;
+  rpci.pDependencies = &dep;
+
+  if (vkCreateRenderPass(device, &rpci, NULL, &renderpass) != VK_SUCCESS) {
+    fprintf(stderr, "%s: couldn't create a Vulkan render pass\n", progname);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* Faces are culled the way view_setup_gl() has GL cull them; edges
+   aren't, since GL never culls lines. */
+static int make_pipelines()
+{
+  VkPushConstantRange range;
+  VkPipelineLayoutCreateInfo plci;
+  VkShaderModule vert, frag;
+  int ok;
+
+  range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  range.offset = 0;
+  range.size = sizeof(vkconsts_t);
+
+  memset(&plci, 0, sizeof(plci));
+  plci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  plci.pushConstantRangeCount = 1;
+  plci.pPushConstantRanges = &range;
+  if (vkCreatePipelineLayout(device, &plci, NULL, &layout) != VK_SUCCESS) {
+    fprintf(stderr, "%s: couldn't create a Vulkan pipeline layout\n",
+      progname);
+    return FALSE;
+  }
+
+  vert = make_shader(vk_vert_spv, sizeof(vk_vert_spv));
+  frag = make_shader(vk_frag_spv, sizeof(vk_frag_spv));
+  if (!vert || !frag)
+    return FALSE;
+
+  ok = (make_pipeline(vert, frag, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP,
+      VK_CULL_MODE_BACK_BIT, &face_pipe)
+    && make_pipeline(vert, frag, VK_PRIMITIVE_TOPOLOGY_LINE_STRIP,
+      VK_CULL_MODE_NONE, &edge_pipe));
+
+  vkDestroyShaderModule(device, vert, NULL);
+  vkDestroyShaderModule(device, frag, NULL);
+  return ok;
+}
+
+static int make_pipeline(VkShaderModule vert, VkShaderModule frag,
+  VkPrimitiveTopology topology, VkCullModeFlags cull, VkPipeline *pipe)
+{
+  static VkDynamicState dynamics[2] = {
+    VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR
+  };
+  VkPipelineShaderStageCreateInfo stages[2];
+  VkVertexInputBindingDescription binding;
+  VkVertexInputAttributeDescription attrs[2];
+  VkPipelineVertexInputStateCreateInfo vis;
+  VkPipelineInputAssemblyStateCreateInfo ias;
+  VkPipelineViewportStateCreateInfo vps;
+  VkPipelineRasterizationStateCreateInfo rs;
+  VkPipelineMultisampleStateCreateInfo ms;
+  VkPipelineDepthStencilStateCreateInfo ds;
+  VkPipelineColorBlendAttachmentState cba;
+  VkPipelineColorBlendStateCreateInfo cbs;
+  VkPipelineDynamicStateCreateInfo dys;
+  VkGraphicsPipelineCreateInfo gpci;
+
+  memset(stages, 0, sizeof(stages));
+  stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+  stages[0].module = vert;
+  stages[0].pName = "main";
+  stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  stages[1].module = frag;
+  stages[1].pName = "main";
+
+  /* One record per instance; the corners come from gl_VertexIndex. */
+  binding.binding = 0;
+  binding.stride = sizeof(vkinst_t);
+  binding.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+  attrs[0].location = 0;
+  attrs[0].binding = 0;
+  attrs[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+  attrs[0].offset = offsetof(vkinst_t, pos);
+  attrs[1].location = 1;
+  attrs[1].binding = 0;
+  attrs[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+  attrs[1].offset = offsetof(vkinst_t, col);
+
+  memset(&vis, 0, sizeof(vis));
+  vis.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vis.vertexBindingDescriptionCount = 1;
+  vis.pVertexBindingDescriptions = &binding;
+  vis.vertexAttributeDescriptionCount = 2;
+  vis.pVertexAttributeDescriptions = attrs;
+
+  memset(&ias, 0, sizeof(ias));
+  ias.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  ias.topology = topology;
+
+  /* The viewport and scissor are set when we draw, so that a resize
+     doesn't mean new pipelines. */
+  memset(&vps, 0, sizeof(vps));
+  vps.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  vps.viewportCount = 1;
+  vps.scissorCount = 1;
+
+  /* vk.vert flips y, so counterclockwise means the same thing it does
+     to GL. */
+  memset(&rs, 0, sizeof(rs));
+  rs.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  rs.polygonMode = VK_POLYGON_MODE_FILL;
+  rs.cullMode = cull;
+  rs.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  rs.lineWidth = 1.0;
+
+  memset(&ms, 0, sizeof(ms));
+  ms.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  ms.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+  memset(&ds, 0, sizeof(ds));
+  ds.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  ds.depthTestEnable = VK_TRUE;
+  ds.depthWriteEnable = VK_TRUE;
+  ds.depthCompareOp = VK_COMPARE_OP_LESS;
+
+  memset(&cba, 0, sizeof(cba));
+  cba.colorWriteMask = (VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT
+    | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT);
+
+  memset(&cbs, 0, sizeof(cbs));
+  cbs.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  cbs.attachmentCount = 1;
+  cbs.pAttachments = &cba;
+
+  memset(&dys, 0, sizeof(dys));
+  dys.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dys.dynamicStateCount = 2;
+  dys.pDynamicStates = dynamics;
+
+  memset(&gpci, 0, sizeof(gpci));
+  gpci.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  gpci.stageCount = 2;
+  gpci.pStages = stages;
+  gpci.pVertexInputState = &vis;
+  gpci.pInputAssemblyState = &ias;
+  gpci.pViewportState = &vps;
+  gpci.pRasterizationState = &rs;
+  gpci.pMultisampleState = &ms;
+  gpci.pDepthStencilState = &ds;
+  gpci.pColorBlendState = &cbs;
+  gpci.pDynamicState = &dys;
+  gpci.layout = layout;
+  gpci.renderPass = renderpass;
+  gpci.subpass = 0;
+
+  if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &gpci, NULL,
+      pipe) != VK_SUCCESS) {
+    fprintf(stderr, "%s: couldn't create a Vulkan pipeline\n", progname);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static VkShaderModule make_shader(const uint32_t *code, size_t size)
+{
+  VkShaderModuleCreateInfo smci;
+  VkShaderModule module;
+
+  memset(&smci, 0, sizeof(smci));
+  smci.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  smci.codeSize = size;
+  smci.pCode = code;
+  if (vkCreateShaderModule(device, &smci, NULL, &module) != VK_SUCCESS) {
+    fprintf(stderr, "%s: couldn't load a Vulkan shader\n", progname);
+    return VK_NULL_HANDLE;
+  }
+  return module;
+}
+
+/* Set the size of the output. Any frames still in the works were drawn at
+   the old size, so they're dropped. soft_resize() has already been
+   called, and we copy our frames into its buffer. */
+int vk_resize(int newwidth, int newheight)
+{
+  VkFramebufferCreateInfo fbci;
+  VkImageView views[2];
+  int ix;
+
+  vkDeviceWaitIdle(device);
+  head = 0;
+  pending = 0;
+
+  for (ix=0; ix<FRAMES_IN_FLIGHT; ix++) {
+    slot_t *slot = &slots[ix];
+    vkDestroyFramebuffer(device, slot->framebuffer, NULL);
+    slot->framebuffer = VK_NULL_HANDLE;
+    free_image(&slot->color);
+    free_image(&slot->depth);
+    free_buffer(&slot->readback);
+  }
+
+  width = newwidth;
+  height = newheight;
+
+  for (ix=0; ix<FRAMES_IN_FLIGHT; ix++) {
+    slot_t *slot = &slots[ix];
+
+    if (!make_image(&slot->color, COLOR_FORMAT,
+	VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+	VK_IMAGE_ASPECT_COLOR_BIT)
+      || !make_image(&slot->depth, DEPTH_FORMAT,
+	VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+	VK_IMAGE_ASPECT_DEPTH_BIT)
+      || !make_buffer(&slot->readback, (VkDeviceSize)width * height * 4,
+	VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT))
+      return FALSE;
+
+    views[0] = slot->color.view;
+    views[1] = slot->depth.view;
+    memset(&fbci, 0, sizeof(fbci));
+    fbci.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    fbci.renderPass = renderpass;
+    fbci.attachmentCount = 2;
+    fbci.pAttachments = views;
+    fbci.width = width;
+    fbci.height = height;
+    fbci.layers = 1;
+    if (vkCreateFramebuffer(device, &fbci, NULL, &slot->framebuffer)
+      != VK_SUCCESS) {
+      fprintf(stderr, "%s: couldn't create a Vulkan framebuffer\n",
+	progname);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Draw a list of polygons, the same way that win_draw() does with GL, and
+   submit it. Then, if the pipe is full, wait for the oldest frame and
+   copy it into soft.c's buffer. Returns TRUE if we did that -- that is,
+   if there's a new frame to show. */
+int vk_draw(elem_t *list, int stride, int edges, int wire)
+{
+  static GLfloat white[] = { 1.0, 1.0, 1.0, 1.0 };
+  static GLfloat grey[] =  { 0.6, 0.6, 0.6, 1.0 };
+  slot_t *slot;
+  vkinst_t *inst;
+  vkconsts_t consts;
+  GLfloat light;
+  VkCommandBufferBeginInfo cbbi;
+  VkRenderPassBeginInfo rpbi;
+  VkClearValue clear[2];
+  VkViewport viewport;
+  VkRect2D scissor;
+  VkDeviceSize offset = 0;
+  VkBufferImageCopy region;
+  VkBufferMemoryBarrier barrier;
+  VkSubmitInfo si;
+  int ix, jx, count;
+
+  if (!width || !height)
+    return FALSE;
+
+  /* Every slot but this one may be in use. This one's last frame has
+     already been waited for and shown. */
+  slot = &slots[(head + pending) % FRAMES_IN_FLIGHT];
+  inst = (vkinst_t *)slot->instances.data;
+
+  count = 0;
+  for (ix=0; ix<NUM_ELS; ix+=stride) {
+    elem_t *el = &list[ix];
+    vkinst_t *in = &inst[count++];
+    for (jx=0; jx<3; jx++) {
+      in->pos[jx] = el->pos[jx];
+      in->col[jx] = pack_channel(el->col[jx]);
+    }
+    in->col[3] = 255;
+  }
+
+  view_transform(consts.mvp, &light);
+  consts.vervec[0] = list[0].vervec[0];
+  consts.vervec[1] = list[0].vervec[1];
+  consts.vervec[2] = light;
+  consts.vervec[3] = 0.0;
+
+  vkResetCommandBuffer(slot->cmd, 0);
+  memset(&cbbi, 0, sizeof(cbbi));
+  cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  cbbi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  vkBeginCommandBuffer(slot->cmd, &cbbi);
+
+  /* soft.c clears to all zeroes, so we do too. */
+  memset(clear, 0, sizeof(clear));
+  clear[1].depthStencil.depth = 1.0;
+
+  memset(&rpbi, 0, sizeof(rpbi));
+  rpbi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  rpbi.renderPass = renderpass;
+  rpbi.framebuffer = slot->framebuffer;
+  rpbi.renderArea.extent.width = width;
+  rpbi.renderArea.extent.height = height;
+  rpbi.clearValueCount = 2;
+  rpbi.pClearValues = clear;
+  vkCmdBeginRenderPass(slot->cmd, &rpbi, VK_SUBPASS_CONTENTS_INLINE);
+
+  viewport.x = 0.0;
+  viewport.y = 0.0;
+  viewport.width = width;
+  viewport.height = height;
+  viewport.minDepth = 0.0;
+  viewport.maxDepth = 1.0;
+  vkCmdSetViewport(slot->cmd, 0, 1, &viewport);
+  scissor.offset.x = 0;
+  scissor.offset.y = 0;
+  scissor.extent.width = width;
+  scissor.extent.height = height;
+  vkCmdSetScissor(slot->cmd, 0, 1, &scissor);
+
+  vkCmdBindVertexBuffers(slot->cmd, 0, 1, &slot->instances.buffer, &offset);
+
+  /* Edges first, so that they win the depth test against their own
+     faces. */
+  if (edges || wire) {
+    GLfloat *col = (wire ? white : grey);
+    consts.flatcol[0] = col[0];
+    consts.flatcol[1] = col[1];
+    consts.flatcol[2] = col[2];
+    consts.flatcol[3] = 1.0;
+    vkCmdBindPipeline(slot->cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, edge_pipe);
+    vkCmdPushConstants(slot->cmd, layout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+      sizeof(consts), &consts);
+    vkCmdDraw(slot->cmd, 5, count, 4, 0);
+  }
+  if (!wire) {
+    memset(consts.flatcol, 0, sizeof(consts.flatcol));
+    vkCmdBindPipeline(slot->cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, face_pipe);
+    vkCmdPushConstants(slot->cmd, layout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+      sizeof(consts), &consts);
+    vkCmdDraw(slot->cmd, 4, count, 0, 0);
+  }
+
+  vkCmdEndRenderPass(slot->cmd);
+
+  memset(&region, 0, sizeof(region));
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.layerCount = 1;
+  region.imageExtent.width = width;
+  region.imageExtent.height = height;
+  region.imageExtent.depth = 1;
+  vkCmdCopyImageToBuffer(slot->cmd, slot->color.image,
+    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->readback.buffer, 1, &region);
+
+  /* ...and we read the copy once the fence says it's done. */
+  memset(&barrier, 0, sizeof(barrier));
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = slot->readback.buffer;
+  barrier.offset = 0;
+  barrier.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(slot->cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+    VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL, 1, &barrier, 0, NULL);
+
+  vkEndCommandBuffer(slot->cmd);
+
+  memset(&si, 0, sizeof(si));
+  si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  si.commandBufferCount = 1;
+  si.pCommandBuffers = &slot->cmd;
+  vkResetFences(device, 1, &slot->fence);
+  if (vkQueueSubmit(queue, 1, &si, slot->fence) != VK_SUCCESS) {
+    fprintf(stderr, "%s: lost the Vulkan device\n", progname);
+    exit(1);
+  }
+  pending++;
+
+  /* Keep FRAMES_IN_FLIGHT-1 frames in the works; the next call will want
+     this slot free. */
+  if (pending < FRAMES_IN_FLIGHT)
+    return FALSE;
+  return vk_finish();
+}
+
+/* Wait for the oldest frame in the works, and copy it into soft.c's
+   buffer. Returns FALSE if there was nothing to wait for. */
+int vk_finish()
+{
+  slot_t *slot;
+  unsigned char *pixels, *src;
+  int stride, y;
+
+  if (!pending)
+    return FALSE;
+
+  slot = &slots[head];
+  vkWaitForFences(device, 1, &slot->fence, VK_TRUE, UINT64_MAX);
+  head = (head + 1) % FRAMES_IN_FLIGHT;
+  pending--;
+
+  pixels = soft_pixels(&stride);
+  src = (unsigned char *)slot->readback.data;
+  for (y=0; y<height; y++)
+    memcpy(pixels + (size_t)y * stride, src + (size_t)y * width * 4,
+      (size_t)width * 4);
+
+  return TRUE;
+}
+
+/* A buffer we can write or read from the CPU, mapped for good. It's
+   always host-coherent, so there's no flushing to do; want is whatever
+   else we'd like (cached memory, for reading). */
+static int make_buffer(vkbuffer_t *buf, VkDeviceSize size,
+  VkBufferUsageFlags usage, VkMemoryPropertyFlags want)
+{
+  VkMemoryPropertyFlags need = (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+    | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  VkBufferCreateInfo bci;
+  VkMemoryRequirements req;
+  VkMemoryAllocateInfo mai;
+  int type;
+
+  memset(&bci, 0, sizeof(bci));
+  bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bci.size = size;
+  bci.usage = usage;
+  bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  if (vkCreateBuffer(device, &bci, NULL, &buf->buffer) != VK_SUCCESS)
+    goto fail;
+
+  vkGetBufferMemoryRequirements(device, buf->buffer, &req);
+  type = find_memory(req.memoryTypeBits, need | want, need);
+  if (type < 0)
+    goto fail;
+
+  memset(&mai, 0, sizeof(mai));
+  mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  mai.allocationSize = req.size;
+  mai.memoryTypeIndex = type;
+  if (vkAllocateMemory(device, &mai, NULL, &buf->memory) != VK_SUCCESS
+    || vkBindBufferMemory(device, buf->buffer, buf->memory, 0) != VK_SUCCESS
+    || vkMapMemory(device, buf->memory, 0, VK_WHOLE_SIZE, 0, &buf->data)
+    != VK_SUCCESS)
+    goto fail;
+
+  return TRUE;
+
+ fail:
+  fprintf(stderr, "%s: couldn't allocate a Vulkan buffer\n", progname);
+  return FALSE;
+}
+
+/* Freeing the memory unmaps it, too. */
+static void free_buffer(vkbuffer_t *buf)
+{
+  vkDestroyBuffer(device, buf->buffer, NULL);
+  vkFreeMemory(device, buf->memory, NULL);
+  buf->buffer = VK_NULL_HANDLE;
+  buf->memory = VK_NULL_HANDLE;
+  buf->data = NULL;
+}
+
+/* An image of the current size, in device memory if there is such a
+   thing (on lavapipe, it's all the same memory). */
+static int make_image(vkimage_t *img, VkFormat format,
+  VkImageUsageFlags usage, VkImageAspectFlags aspect)
+{
+  VkImageCreateInfo ici;
+  VkImageViewCreateInfo ivci;
+  VkMemoryRequirements req;
+  VkMemoryAllocateInfo mai;
+  int type;
+
+  memset(&ici, 0, sizeof(ici));
+  ici.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  ici.imageType = VK_IMAGE_TYPE_2D;
+  ici.format = format;
+  ici.extent.width = width;
+  ici.extent.height = height;
+  ici.extent.depth = 1;
+  ici.mipLevels = 1;
+  ici.arrayLayers = 1;
+  ici.samples = VK_SAMPLE_COUNT_1_BIT;
+  ici.tiling = VK_IMAGE_TILING_OPTIMAL;
+  ici.usage = usage;
+  ici.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  ici.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  if (vkCreateImage(device, &ici, NULL, &img->image) != VK_SUCCESS)
+    goto fail;
+
+  vkGetImageMemoryRequirements(device, img->image, &req);
+  type = find_memory(req.memoryTypeBits,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+  if (type < 0)
+    goto fail;
+
+  memset(&mai, 0, sizeof(mai));
+  mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  mai.allocationSize = req.size;
+  mai.memoryTypeIndex = type;
+  if (vkAllocateMemory(device, &mai, NULL, &img->memory) != VK_SUCCESS
+    || vkBindImageMemory(device, img->image, img->memory, 0) != VK_SUCCESS)
+    goto fail;
+
+  memset(&ivci, 0, sizeof(ivci));
+  ivci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  ivci.image = img->image;
+  ivci.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  ivci.format = format;
+  ivci.subresourceRange.aspectMask = aspect;
+  ivci.subresourceRange.levelCount = 1;
+  ivci.subresourceRange.layerCount = 1;
+  if (vkCreateImageView(device, &ivci, NULL, &img->view) != VK_SUCCESS)
+    goto fail;
+
+  return TRUE;
+
+ fail:
+  fprintf(stderr, "%s: couldn't allocate a Vulkan image\n", progname);
+  return FALSE;
+}
+
+static void free_image(vkimage_t *img)
+{
+  vkDestroyImageView(device, img->view, NULL);
+  vkDestroyImage(device, img->image, NULL);
+  vkFreeMemory(device, img->memory, NULL);
+  img->view = VK_NULL_HANDLE;
+  img->image = VK_NULL_HANDLE;
+  img->memory = VK_NULL_HANDLE;
+}
+
+/* The first memory type allowed by typebits that has all the want
+   properties; failing that, the first that has the need properties.
+   Returns -1 if there's none. */
+static int find_memory(uint32_t typebits, VkMemoryPropertyFlags want,
+  VkMemoryPropertyFlags need)
+{
+  uint32_t ix;
+
+  for (ix=0; ix<memprops.memoryTypeCount; ix++) {
+    VkMemoryPropertyFlags flags = memprops.memoryTypes[ix].propertyFlags;
+    if ((typebits & (1 << ix)) && (flags & want) == want)
+      return ix;
+  }
+  for (ix=0; ix<memprops.memoryTypeCount; ix++) {
+    VkMemoryPropertyFlags flags = memprops.memoryTypes[ix].propertyFlags;
+    if ((typebits & (1 << ix)) && (flags & need) == need)
+      return ix;
+  }
+  return -1;
+}
+
+static GLubyte pack_channel(GLfloat val)
+{
+  if (val >= 1.0)
+    return 255;
+  if (val <= 0.0)
+    return 0;
+  return (GLubyte)(val * 255.0 + 0.5);
+}
@@ -0,0 +1,15 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+#version 450
+
+layout(location = 0) flat in vec4 color;
+layout(location = 0) out vec4 frag;
+
+void main() {
+  frag = color;
+}
@@ -0,0 +1,24 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+#ifdef HAVE_VULKAN
+
+extern int vk_init(void);
+extern int vk_resize(int width, int height);
+extern int vk_draw(elem_t *list, int stride, int edges, int wire);
+extern int vk_finish(void);
+
+#else /* HAVE_VULKAN */
+
+/* Built without Vulkan. init_view() refuses --renderer vulkan, so none of
+   these are ever reached. */
+#define vk_init() (FALSE)
+#define vk_resize(width, height) (FALSE)
+#define vk_draw(list, stride, edges, wire) (FALSE)
+#define vk_finish() (FALSE)
+
+#endif /* HAVE_VULKAN */
@@ -0,0 +1,41 @@
+/* StonerView: An eccentric visual toy.
+   Copyright 1998-2001 by Andrew Plotkin (erkyrath@eblong.com)
+   http://www.eblong.com/zarf/stonerview.html
+   This program is distributed under the GPL.
+   See main.c, the Copying document, or the above URL for details.
+*/
+
+/* The vertex shader for --renderer vulkan. Each instance is one polygon,
+   and gl_VertexIndex picks the corner: 0-3 are the face, as a triangle
+   strip, and 4-8 are the edge, as a line strip that closes on itself.
+   The sums are the ones packed.c's shader does. */
+
+#version 450
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec4 col;
+
+layout(push_constant) uniform consts {
+  mat4 mvp;
+  vec4 vervec; /* x and y are vervec; z is the light factor */
+  vec4 flatcol; /* a is 1.0 to use this color instead of col */
+} pc;
+
+layout(location = 0) flat out vec4 color;
+
+const vec2 corners[9] = vec2[](
+  vec2(-1.0, 0.0), vec2(0.0, -1.0), vec2(0.0, 1.0), vec2(1.0, 0.0),
+  vec2(-1.0, 0.0), vec2(0.0, -1.0), vec2(1.0, 0.0), vec2(0.0, 1.0),
+  vec2(-1.0, 0.0));
+
+void main() {
+  vec2 corner = corners[gl_VertexIndex];
+  vec2 vv = pc.vervec.xy;
+  vec2 off = corner.x * vv + corner.y * vec2(-vv.y, vv.x);
+  vec4 p = pc.mvp * vec4(pos.xy + off, pos.z, 1.0);
+  /* view_transform() gives us GL's clip space, which has y up and z from
+     -w to w. Vulkan's has y down and z from 0 to w. */
+  gl_Position = vec4(p.x, -p.y, (p.z + p.w) * 0.5, p.w);
+  color = vec4(min(mix(col.rgb, pc.flatcol.rgb, pc.flatcol.a)
+    * pc.vervec.z, 1.0), 1.0);
+}